@@ -0,0 +1,351 @@
+// Throughput and latency of the `portable` Fingerprint128 next to Google's reference.
+//
+// Writes one JSON document to standard output, with one record per
+// (implementation, length, alignment, cache state) combination:
+//
+//     ./bench > bench.json
+//     ./bench --quick --max-length 65536 > bench.json
+//
+// Lengths cover every value from 0 to 127 (the `HashLen0to16()` and
+// `CityMurmur()` paths), a spread from 128 bytes to 4 KiB and powers of four
+// up to 64 MiB.  Every length is measured at alignment 0; a handful of
+// representative lengths are also measured at every misalignment from 1 to 15.
+//
+// "hot" hashes the same buffer over and over.  "cold" walks through a pool of
+// buffers much larger than the last-level cache, so every call starts with its
+// input out of cache (and, for short inputs, out of the TLB).
+//
+// Cycles and instructions come from `perf_event_open()`, and are `null` if it
+// is not permitted (see `/proc/sys/kernel/perf_event_paranoid`).
+//
+#include "FarmHash.hpp"
+
+#if !defined(BENCH_NO_REFERENCE)
+#   include "farmhash.h"
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+using namespace std;
+
+namespace {
+
+    // -----------------------------------------------------------------
+    // Hardware counters.
+
+    class Counters {
+
+    public:
+
+        Counters() : cycles_(-1), instructions_(-1) {
+            cycles_ = Open(PERF_COUNT_HW_CPU_CYCLES, -1);
+            if (cycles_ >= 0) {
+                instructions_ = Open(PERF_COUNT_HW_INSTRUCTIONS, cycles_);
+                if (instructions_ < 0) {
+                    close(cycles_);
+                    cycles_ = -1;
+                }
+            }
+        }
+
+        ~Counters() {
+            if (instructions_ >= 0) close(instructions_);
+            if (cycles_ >= 0) close(cycles_);
+        }
+
+        bool Available() const { return cycles_ >= 0; }
+
+        void Start() {
+            if (!Available()) return;
+            ioctl(cycles_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(cycles_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        void Stop(uint64_t &cycles, uint64_t &instructions) {
+            cycles = instructions = 0;
+            if (!Available()) return;
+            ioctl(cycles_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t values[3]; // { nr, cycles, instructions } with PERF_FORMAT_GROUP
+            if (read(cycles_, values, sizeof(values)) == sizeof(values)) {
+                cycles = values[1];
+                instructions = values[2];
+            }
+        }
+
+    private:
+
+        static int Open(uint64_t config, int group) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = config;
+            attr.disabled = group < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+        }
+
+        int cycles_;
+        int instructions_;
+
+    };
+
+    // -----------------------------------------------------------------
+    // The implementations under test.
+
+    typedef uint64_t (*Hasher)(const uint8_t *input, size_t length);
+
+    uint64_t Portable(const uint8_t *input, size_t length) {
+        UInt128 h = FarmHash::Fingerprint128(input, length);
+        return UInt128Low64(h) ^ UInt128High64(h);
+    }
+
+#if !defined(BENCH_NO_REFERENCE)
+    uint64_t Reference(const uint8_t *input, size_t length) {
+        util::uint128_t h = util::Fingerprint128(reinterpret_cast<const char *>(input), length);
+        return util::Uint128Low64(h) ^ util::Uint128High64(h);
+    }
+#endif
+
+    struct Implementation {
+        const char *name;
+        Hasher hash;
+    };
+
+    // -----------------------------------------------------------------
+    // Measurement.
+
+    struct Options {
+        bool quick;
+        size_t max_length;
+        size_t cold_pool;
+    };
+
+    struct Result {
+        double ns_per_hash;
+        double cycles;       // per hash, or negative if unavailable
+        double instructions; // per hash, or negative if unavailable
+    };
+
+    volatile uint64_t sink;
+
+    // Hash 'count' inputs of 'length' bytes, the k-th at 'base + (k % slots) * stride'.
+
+    Result Measure(const Implementation &impl, Counters &counters, const uint8_t *base, size_t stride, size_t slots, size_t length, const Options &options) {
+
+        const double target = options.quick ? 0.005 : 0.02; // seconds per repetition
+        const int repetitions = options.quick ? 3 : 7;
+
+        // Calibrate the number of calls per repetition.
+
+        size_t count = 1;
+        for (;;) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            uint64_t x = 0;
+            for (size_t k = 0; k < count; k++) {
+                x += impl.hash(base + (k % slots) * stride, length);
+            }
+            sink = x;
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (seconds > target / 4 || count >= (size_t(1) << 30)) {
+                count = max<size_t>(1, size_t(count * target / max(seconds, 1e-9)));
+                break;
+            }
+            count *= 4;
+        }
+
+        // Keep the fastest repetition; everything else is noise.
+
+        Result best = { 1e300, -1, -1 };
+        for (int r = 0; r < repetitions; r++) {
+            uint64_t cycles, instructions, x = 0;
+            counters.Start();
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (size_t k = 0; k < count; k++) {
+                x += impl.hash(base + (k % slots) * stride, length);
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            counters.Stop(cycles, instructions);
+            sink = x;
+            double ns = seconds * 1e9 / count;
+            if (ns < best.ns_per_hash) {
+                best.ns_per_hash = ns;
+                best.cycles = counters.Available() ? double(cycles) / count : -1;
+                best.instructions = counters.Available() ? double(instructions) / count : -1;
+            }
+        }
+
+        return best;
+
+    }
+
+    void Number(double value, bool valid) {
+        if (valid) {
+            printf("%.4f", value);
+        } else {
+            printf("null");
+        }
+    }
+
+    void Report(bool &first, const Implementation &impl, size_t length, size_t alignment, const char *cache, const Result &r) {
+        printf("%s\n    {\"impl\": \"%s\", \"length\": %zu, \"alignment\": %zu, \"cache\": \"%s\", \"ns_per_hash\": ", first ? "" : ",", impl.name, length, alignment, cache);
+        first = false;
+        Number(r.ns_per_hash, true);
+        printf(", \"gb_per_s\": ");
+        Number(length / r.ns_per_hash, length > 0);
+        printf(", \"cycles_per_hash\": ");
+        Number(r.cycles, r.cycles >= 0);
+        printf(", \"cycles_per_byte\": ");
+        Number(r.cycles / length, r.cycles >= 0 && length > 0);
+        printf(", \"ipc\": ");
+        Number(r.instructions / r.cycles, r.cycles > 0);
+        printf("}");
+        fflush(stdout);
+    }
+
+    vector<size_t> Lengths(size_t max_length) {
+        vector<size_t> lengths;
+        for (size_t n = 0; n < 128; n++) {
+            lengths.push_back(n);
+        }
+        const size_t medium[] = { 128, 129, 143, 144, 160, 192, 255, 256, 383, 384, 511, 512, 768, 1000, 1024, 1536, 2048, 3000, 4095, 4096 };
+        for (size_t i = 0; i < sizeof(medium) / sizeof(medium[0]); i++) {
+            lengths.push_back(medium[i]);
+        }
+        for (size_t n = 16 * 1024; n <= 64 * 1024 * 1024; n *= 4) {
+            lengths.push_back(n);
+        }
+        while (!lengths.empty() && lengths.back() > max_length) {
+            lengths.pop_back();
+        }
+        return lengths;
+    }
+
+    bool Misaligned(size_t length) {
+        const size_t lengths[] = { 3, 8, 15, 16, 31, 32, 64, 100, 127, 128, 144, 1024, 4096, 1024 * 1024 };
+        for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            if (lengths[i] == length) return true;
+        }
+        return false;
+    }
+
+    // The distance between "cold" inputs of 'length' bytes.
+    size_t Stride(size_t length) {
+        return ((length + 4095) & ~size_t(4095)) + 4096 + 64 * 7;
+    }
+
+    // A whole decimal, octal or hex number no larger than 'limit'.
+    bool ParseSize(const char *text, size_t limit, size_t &value) {
+        char *end;
+        errno = 0;
+        unsigned long long parsed = strtoull(text, &end, 0);
+        if (end == text || *end || errno || strchr(text, '-') || parsed > limit) {
+            return false;
+        }
+        value = static_cast<size_t>(parsed);
+        return true;
+    }
+
+    void Usage(const char *argv0) {
+        fprintf(stderr, "usage: %s [--quick] [--max-length BYTES] [--cold-pool MIB]\n", argv0);
+        exit(2);
+    }
+
+}
+
+int main(int argc, char const *argv[])
+{
+
+    Options options = { false, 64 * 1024 * 1024, 512 };
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--max-length" && i + 1 < argc) {
+            if (!ParseSize(argv[++i], SIZE_MAX, options.max_length)) {
+                Usage(argv[0]);
+            }
+        } else if (arg == "--cold-pool" && i + 1 < argc) {
+            if (!ParseSize(argv[++i], SIZE_MAX >> 20, options.cold_pool)) {
+                Usage(argv[0]);
+            }
+        } else {
+            Usage(argv[0]);
+        }
+    }
+
+    vector<Implementation> implementations;
+    Implementation portable = { "portable", Portable };
+    implementations.push_back(portable);
+#if !defined(BENCH_NO_REFERENCE)
+    Implementation reference = { "reference", Reference };
+    implementations.push_back(reference);
+#endif
+
+    vector<size_t> lengths = Lengths(options.max_length);
+    size_t largest = lengths.back();
+
+    // The cold pool holds at least one slot of the largest input at every
+    // alignment, and is page-aligned so that 'alignment' below is exact.
+
+    size_t pool_size = options.cold_pool << 20;
+    if (pool_size < largest + 16 + Stride(largest)) {
+        fprintf(stderr, "error: --cold-pool must be at least %zu MiB for --max-length %zu\n", ((largest + 16 + Stride(largest)) >> 20) + 1, options.max_length);
+        return 2;
+    }
+    uint8_t *pool = static_cast<uint8_t *>(aligned_alloc(4096, pool_size));
+    if (!pool) {
+        fprintf(stderr, "error: cannot allocate %zu bytes\n", pool_size);
+        return 1;
+    }
+    srand(42);
+    for (size_t i = 0; i < pool_size; i++) {
+        pool[i] = static_cast<uint8_t>(rand());
+    }
+
+    Counters counters;
+
+    printf("{\n  \"format\": 1,\n  \"compiler\": \"%s\",\n  \"perf_counters\": %s,\n  \"results\": [", __VERSION__, counters.Available() ? "true" : "false");
+
+    bool first = true;
+    for (size_t l = 0; l < lengths.size(); l++) {
+        size_t length = lengths[l];
+        size_t alignments = Misaligned(length) ? 16 : 1;
+        for (size_t alignment = 0; alignment < alignments; alignment++) {
+            for (size_t i = 0; i < implementations.size(); i++) {
+
+                Result hot = Measure(implementations[i], counters, pool + alignment, 0, 1, length, options);
+                Report(first, implementations[i], length, alignment, "hot", hot);
+
+                // Page-spaced slots, plus an odd number of cache lines so that
+                // short inputs do not all land in the same cache set.
+
+                size_t stride = Stride(length);
+                size_t slots = max<size_t>(1, (pool_size - alignment - length) / stride);
+                Result cold = Measure(implementations[i], counters, pool + alignment, stride, slots, length, options);
+                Report(first, implementations[i], length, alignment, "cold", cold);
+
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+
+    free(pool);
+
+    return 0;
+}
@@ -8,7 +8,7 @@
 #   include <Windows.h>
 #endif
 
-#if defined(__LITTLE_ENDIAN__) || defined(_LITTLE_ENDIAN) || (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)) || (defined(REG_DWORD_LITTLE_ENDIAN) && defined(REG_QWORD_LITTLE_ENDIAN))
+#if defined(__LITTLE_ENDIAN__) || defined(_LITTLE_ENDIAN) || (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) || (defined(REG_DWORD_LITTLE_ENDIAN) && defined(REG_QWORD_LITTLE_ENDIAN))
 #   define IS_LITTLE_ENDIAN
 #elif defined(__BIG_ENDIAN__) || defined(_BIG_ENDIAN) || (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)) || (defined(REG_DWORD_BIG_ENDIAN) && defined(REG_QWORD_BIG_ENDIAN))
 #   define IS_BIG_ENDIAN
@@ -57,19 +57,45 @@ namespace FarmHash {
 
     UInt128 Fingerprint128(const uint8_t *input, size_t length);
 
+    // Writes the 16 bytes of `UInt128ToBytes()`, which are the same on every platform.
+
     inline void Fingerprint128(const uint8_t *input, size_t length, uint8_t *output) {
-        *((UInt128 *)output) = Fingerprint128(input, length);
+        UInt128ToBytes(Fingerprint128(input, length), output);
     }
 
     inline UInt128 Fingerprint128(const int8_t *input, size_t length)                  { return Fingerprint128((uint8_t *)input, length);  }
     inline    void Fingerprint128(const int8_t *input, size_t length, uint8_t *output) { Fingerprint128((uint8_t *)input, length, output); }
 
     template <typename STR>
-    inline UInt128 Fingerprint128(const STR &s) {
+    inline auto Fingerprint128(const STR &s) -> decltype(s.data(), s.length(), UInt128()) {
         static_assert(sizeof(s[0]) == 1, "elements of 'STR' must have a size equal to one");
-        return Fingerprint128(s.data(), s.length());
+        return Fingerprint128(reinterpret_cast<const uint8_t *>(s.data()), s.length());
     }
 
+    // CityHash128 of `input` with an explicit seed, in place of the one
+    // `Fingerprint128()` takes from the first 16 bytes.
+
+    UInt128 CityHash128WithSeed(const uint8_t *input, size_t length, UInt128 seed);
+
+    // `k` seeded hashes of one input, so that `out[j] == CityHash128WithSeed(input, length, seeds[j])`,
+    // as for MinHash or for filters needing several hashes, in one pass over the input.
+
+    void Fingerprint128MultiSeed(const uint8_t *input, size_t length, const UInt128 *seeds, size_t k, UInt128 *out);
+
+    // Fingerprint `n` independent inputs, so that `out[i] == Fingerprint128(inputs[i], lengths[i])`.
+    // Inputs of 144 bytes or more are run several at a time in SIMD lanes (AVX-512,
+    // when the CPU has it) and everything else uses the scalar code; the
+    // results are identical either way.
+
+    void Fingerprint128Batch(const uint8_t * const *inputs, const size_t *lengths, UInt128 *out, size_t n);
+
+    // Fingerprint the `rows` strings of an Arrow-style column, so that
+    // `out[i] == Fingerprint128(data + offsets[i], offsets[i + 1] - offsets[i])`.
+    // Rows ahead are prefetched, which helps columns larger than the cache.
+
+    void Fingerprint128Column(const uint8_t *data, const uint32_t *offsets, size_t rows, UInt128 *out);
+    void Fingerprint128Column(const uint8_t *data, const uint64_t *offsets, size_t rows, UInt128 *out);
+
 }
 
 #endif // ! FARM_HASH_HPP
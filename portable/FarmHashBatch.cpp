@@ -0,0 +1,232 @@
+// Multi-buffer `Fingerprint128`: several independent inputs hashed side by side
+// in the lanes of a SIMD register, with the kernel picked at runtime.
+//
+// Copyright (c) 2014 Google, Inc.
+//
+// Numerous Modifications and Optimizations
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Only the `len >= 128` main loop of CityHash128WithSeed() is vectorized; that is
+// where the time goes for anything but short inputs.  Short inputs, the seeding,
+// the tail and whatever blocks one lane has beyond the shortest lane of its
+// group are all done with the scalar code, so the results are bit-identical.
+//
+// The vector code is written with the GCC/Clang `vector_size` extension and
+// compiled once per instruction set via `target` attributes; the compiler
+// lowers the 64-bit multiplies to `vpmullq` when AVX-512DQ is enabled and to
+// a `vpmuludq` sequence when only AVX-512F is.  There is deliberately no AVX2
+// or SSE4.2 kernel: with four (or two) lanes the emulated multiplies make the
+// vector loop slower than the scalar one, so those CPUs use the scalar code,
+// as do other compilers and architectures.
+//
+#include "FarmHash.hpp"
+#include "FarmHashDetail.hpp"
+
+#if (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)) && defined(__x86_64__)
+#   define FARM_HASH_BATCH_X86_64
+#endif
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    namespace {
+
+        typedef void (*BatchKernel)(const uint8_t * const *inputs, const size_t *lengths, UInt128 *out, size_t n);
+
+        // Hash one input completely, given that its seeded state is already in `st`.
+
+        inline UInt128 FinishLane(CityHash128State &st, const uint8_t *s, size_t len) {
+            while (len >= 128) {
+                CityHash128Block(st, s);
+                s += 128;
+                len -= 128;
+            }
+            return CityHash128End(st, s, len);
+        }
+
+        void BatchScalar(const uint8_t * const *inputs, const size_t *lengths, UInt128 *out, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                out[i] = Fingerprint128(inputs[i], lengths[i]);
+            }
+        }
+
+    #if defined(FARM_HASH_BATCH_X86_64)
+
+        #define FARM_HASH_ALWAYS_INLINE inline __attribute__((always_inline))
+
+        const size_t kLanes = 8;
+
+        typedef uint64_t U64x8 __attribute__((vector_size(64)));
+
+        FARM_HASH_ALWAYS_INLINE void RotateRight(U64x8 &value, unsigned shift) {
+            value = (value >> shift) | (value << (64 - shift));
+        }
+
+        // Turn eight rows of eight words (one row per lane) into eight vectors of
+        // the same word across all lanes.  Only ever run on little-endian x86.
+
+        FARM_HASH_ALWAYS_INLINE void Transpose(const U64x8 *r, U64x8 *d) {
+            U64x8 t[8], u[8];
+            for (int i = 0; i < 8; i += 2) {
+                t[i]     = __builtin_shufflevector(r[i], r[i + 1], 0, 8, 2, 10, 4, 12, 6, 14);
+                t[i + 1] = __builtin_shufflevector(r[i], r[i + 1], 1, 9, 3, 11, 5, 13, 7, 15);
+            }
+            for (int i = 0; i < 8; i += 4) {
+                for (int k = 0; k < 2; k++) {
+                    u[i + k]     = __builtin_shufflevector(t[i + k], t[i + k + 2], 0, 1, 8, 9, 4, 5, 12, 13);
+                    u[i + k + 2] = __builtin_shufflevector(t[i + k], t[i + k + 2], 2, 3, 10, 11, 6, 7, 14, 15);
+                }
+            }
+            for (int k = 0; k < 4; k++) {
+                d[k]     = __builtin_shufflevector(u[k], u[k + 4], 0, 1, 2, 3, 8, 9, 10, 11);
+                d[k + 4] = __builtin_shufflevector(u[k], u[k + 4], 4, 5, 6, 7, 12, 13, 14, 15);
+            }
+        }
+
+        // Half of CityHash128Block() in every lane at once; word `j` of the 64
+        // bytes being consumed by lane `i` is `d[j][i]`.
+
+        FARM_HASH_ALWAYS_INLINE void HalfBlockLanes(U64x8 &x, U64x8 &y, U64x8 &z, U64x8 &v1, U64x8 &v2, U64x8 &w1, U64x8 &w2, const U64x8 *d) {
+            U64x8 a, b, c, r;
+            x = x + y + v1 + d[1]; RotateRight(x, 37); x = x * k1;
+            y = y + v2 + d[6];     RotateRight(y, 42); y = y * k1;
+            x ^= w2;
+            y += v1 + d[5];
+            z = z + w1;            RotateRight(z, 33); z = z * k1;
+            // v = WeakHashLen32WithSeeds(s, v.second * k1, x + w.first)
+            a = v2 * k1 + d[0];
+            b = x + w1 + a + d[3]; RotateRight(b, 21);
+            c = a;
+            a += d[1];
+            a += d[2];
+            r = a;                 RotateRight(r, 44);
+            v1 = a + d[3];
+            v2 = b + r + c;
+            // w = WeakHashLen32WithSeeds(s + 32, z + w.second, y + Fetch64(s + 16))
+            a = z + w2 + d[4];
+            b = y + d[2] + a + d[7]; RotateRight(b, 21);
+            c = a;
+            a += d[5];
+            a += d[6];
+            r = a;                 RotateRight(r, 44);
+            w1 = a + d[7];
+            w2 = b + r + c;
+            std::swap(z, x);
+        }
+
+        FARM_HASH_ALWAYS_INLINE void BlockLanes(CityHash128State *st, const uint8_t * const *s, size_t blocks) {
+            U64x8 x, y, z, v1, v2, w1, w2;
+            for (size_t i = 0; i < kLanes; i++) {
+                x[i] = st[i].x; y[i] = st[i].y; z[i] = st[i].z;
+                v1[i] = st[i].v.first; v2[i] = st[i].v.second;
+                w1[i] = st[i].w.first; w2[i] = st[i].w.second;
+            }
+            for (size_t offset = 0; offset < blocks * 128; offset += 128) {
+                U64x8 rows[kLanes], d[8];
+                for (size_t half = 0; half < 128; half += 64) {
+                    for (size_t i = 0; i < kLanes; i++) {
+                        std::memcpy(&rows[i], s[i] + offset + half, sizeof(U64x8));
+                    }
+                    Transpose(rows, d);
+                    HalfBlockLanes(x, y, z, v1, v2, w1, w2, d);
+                }
+            }
+            for (size_t i = 0; i < kLanes; i++) {
+                st[i].x = x[i]; st[i].y = y[i]; st[i].z = z[i];
+                st[i].v.first = v1[i]; st[i].v.second = v2[i];
+                st[i].w.first = w1[i]; st[i].w.second = w2[i];
+            }
+        }
+
+        // Collect inputs long enough for the main loop into groups of `kLanes`,
+        // run each group for as many blocks as its shortest member has, and
+        // finish everything else with the scalar code.
+
+        FARM_HASH_ALWAYS_INLINE void BatchLanes(const uint8_t * const *inputs, const size_t *lengths, UInt128 *out, size_t n) {
+            CityHash128State st[kLanes];
+            const uint8_t *s[kLanes];
+            size_t len[kLanes];
+            size_t index[kLanes];
+            size_t lanes = 0;
+            for (size_t k = 0; k < n; k++) {
+                const uint8_t *p = inputs[k];
+                size_t l = lengths[k];
+                UInt128 seed = CityHash128Seed(p, l);
+                if (l < 128) {
+                    out[k] = CityMurmur(p, l, seed);
+                    continue;
+                }
+                CityHash128Begin(st[lanes], p, l, seed);
+                s[lanes] = p;
+                len[lanes] = l;
+                index[lanes] = k;
+                if (++lanes < kLanes) {
+                    continue;
+                }
+                size_t blocks = *std::min_element(len, len + kLanes) / 128;
+                BlockLanes(st, s, blocks);
+                for (size_t i = 0; i < kLanes; i++) {
+                    out[index[i]] = FinishLane(st[i], s[i] + blocks * 128, len[i] - blocks * 128);
+                }
+                lanes = 0;
+            }
+            for (size_t i = 0; i < lanes; i++) {
+                out[index[i]] = FinishLane(st[i], s[i], len[i]);
+            }
+        }
+
+        __attribute__((target("avx512f")))
+        void BatchAVX512F(const uint8_t * const *inputs, const size_t *lengths, UInt128 *out, size_t n) {
+            BatchLanes(inputs, lengths, out, n);
+        }
+
+        __attribute__((target("avx512f,avx512dq")))
+        void BatchAVX512DQ(const uint8_t * const *inputs, const size_t *lengths, UInt128 *out, size_t n) {
+            BatchLanes(inputs, lengths, out, n);
+        }
+
+        #undef FARM_HASH_ALWAYS_INLINE
+
+    #endif
+
+        BatchKernel SelectBatchKernel() {
+        #if defined(FARM_HASH_BATCH_X86_64)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return __builtin_cpu_supports("avx512dq") ? BatchAVX512DQ : BatchAVX512F;
+            }
+        #endif
+            return BatchScalar;
+        }
+
+    }
+
+    void Fingerprint128Batch(const uint8_t * const *inputs, const size_t *lengths, UInt128 *out, size_t n) {
+        static const BatchKernel kernel = SelectBatchKernel();
+        kernel(inputs, lengths, out, n);
+    }
+
+}
@@ -0,0 +1,331 @@
+// Content-defined chunking, with a `Fingerprint128` for every chunk.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FarmHashChunker.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <cassert>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    namespace {
+
+        // Input is scanned for candidate chunk ends in pieces of this size.
+
+        const size_t kSegment = 256 * 1024;
+
+        // Roughly this many bytes of chunks are fingerprinted per task.
+
+        const size_t kFingerprintGrain = 1024 * 1024;
+
+        // A chunk may end at 'end' if the hash has the loose mask's bits clear,
+        // and may end before the average size only if it has the strict one's.
+
+        struct Candidate {
+            uint64_t end;
+            bool strict;
+        };
+
+        struct Masks {
+            uint64_t strict, loose;
+        };
+
+        // 'sizes' with 'min' raised to 64 and each size at least the one before.
+
+        ChunkSizes Ordered(const ChunkSizes &sizes) {
+            size_t min = std::max<size_t>(64, sizes.min);
+            size_t average = std::max(min, sizes.average);
+            return ChunkSizes(min, average, std::max(average, sizes.max));
+        }
+
+        Masks MasksFor(const ChunkSizes &sizes) {
+            assert(64 <= sizes.min && sizes.min <= sizes.average && sizes.average <= sizes.max);
+            int bits = 0;
+            while ((size_t(2) << bits) <= sizes.average) {
+                bits++;
+            }
+            Masks masks = { ~uint64_t(0) << (64 - (bits + 2)), ~uint64_t(0) << (64 - (bits - 2)) };
+            return masks;
+        }
+
+        const uint64_t *Gear() {
+            struct Table {
+                uint64_t values[256];
+                Table() {
+                    for (uint64_t i = 0; i < 256; i++) {
+                        values[i] = Hash128to64(UInt128(i, kChunkerVersion));
+                    }
+                }
+            };
+            static const Table table;
+            return table.values;
+        }
+
+        uint64_t WarmUp(const uint8_t *input, size_t at) {
+            const uint64_t *gear = Gear();
+            uint64_t h = 0;
+            for (size_t i = at >= 64 ? at - 64 : 0; i < at; i++) {
+                h = (h << 1) + gear[input[i]];
+            }
+            return h;
+        }
+
+        // Candidate ends in '(begin, end]', where the hash at each end covers the
+        // 64 bytes before it.  Each hash step depends on the previous one, so the
+        // range is cut into four parts whose hashes are run side by side.
+
+        void ScanSegment(const uint8_t *input, size_t begin, size_t end, const Masks &masks, std::vector<Candidate> &candidates) {
+
+            const uint64_t *gear = Gear();
+            const uint64_t loose = masks.loose;
+            size_t part = (end - begin) / 4;
+            size_t a = begin, b = a + part, c = b + part, d = c + part;
+            uint64_t ha = WarmUp(input, a), hb = WarmUp(input, b), hc = WarmUp(input, c), hd = WarmUp(input, d);
+            std::vector<Candidate> found[4];
+
+            for (size_t i = 0; i < part; i++) {
+                ha = (ha << 1) + gear[input[a + i]];
+                hb = (hb << 1) + gear[input[b + i]];
+                hc = (hc << 1) + gear[input[c + i]];
+                hd = (hd << 1) + gear[input[d + i]];
+                if (IsUnlikely(((ha & loose) == 0) | ((hb & loose) == 0) | ((hc & loose) == 0) | ((hd & loose) == 0))) {
+                    const uint64_t h[4] = { ha, hb, hc, hd };
+                    for (size_t l = 0; l < 4; l++) {
+                        if ((h[l] & loose) == 0) {
+                            Candidate candidate = { begin + l * part + i + 1, (h[l] & masks.strict) == 0 };
+                            found[l].push_back(candidate);
+                        }
+                    }
+                }
+            }
+
+            // The last part also takes the remainder.
+
+            for (size_t i = d + part; i < end; i++) {
+                hd = (hd << 1) + gear[input[i]];
+                if (IsUnlikely((hd & loose) == 0)) {
+                    Candidate candidate = { i + 1, (hd & masks.strict) == 0 };
+                    found[3].push_back(candidate);
+                }
+            }
+
+            for (size_t l = 0; l < 4; l++) {
+                candidates.insert(candidates.end(), found[l].begin(), found[l].end());
+            }
+
+        }
+
+        void Scan(const uint8_t *input, size_t length, const Masks &masks, ThreadPool &pool, std::vector<Candidate> &candidates) {
+            size_t segments = (length + kSegment - 1) / kSegment;
+            std::vector<std::vector<Candidate> > found(segments);
+            pool.ParallelFor(0, segments, 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    ScanSegment(input, i * kSegment, std::min(length, (i + 1) * kSegment), masks, found[i]);
+                }
+            });
+            for (size_t i = 0; i < segments; i++) {
+                candidates.insert(candidates.end(), found[i].begin(), found[i].end());
+            }
+        }
+
+        // Cut '[0, length)' into chunks, starting at 'offset' in the input.  Unless
+        // this is the end of the input, stop at the first chunk that more input
+        // could change, and return where it starts.
+
+        size_t Select(const std::vector<Candidate> &candidates, size_t length, bool final, const ChunkSizes &sizes, uint64_t offset, std::vector<Chunk> &chunks) {
+            size_t start = 0, k = 0, n = candidates.size();
+            while (start < length) {
+                while (k < n && candidates[k].end < start + sizes.min) {
+                    k++;
+                }
+                size_t end = 0;
+                for (size_t j = k; j < n && candidates[j].end <= start + sizes.average; j++) {
+                    if (candidates[j].strict) {
+                        end = candidates[j].end;
+                        break;
+                    }
+                }
+                for (size_t j = k; !end && j < n && candidates[j].end <= start + sizes.max; j++) {
+                    if (candidates[j].end > start + sizes.average) {
+                        end = candidates[j].end;
+                    }
+                }
+                if (!end) {
+                    if (start + sizes.max <= length) {
+                        end = start + sizes.max;
+                    } else if (final) {
+                        end = length;
+                    } else {
+                        break;
+                    }
+                }
+                Chunk chunk = { offset + start, end - start, UInt128() };
+                chunks.push_back(chunk);
+                start = end;
+            }
+            return start;
+        }
+
+        // 'base' holds the input from 'offset' on.
+
+        void FingerprintRange(const uint8_t *base, uint64_t offset, Chunk *chunks, size_t n) {
+            std::vector<const uint8_t *> inputs(n);
+            std::vector<size_t> lengths(n);
+            std::vector<UInt128> out(n);
+            for (size_t i = 0; i < n; i++) {
+                inputs[i] = base + (chunks[i].offset - offset);
+                lengths[i] = chunks[i].length;
+            }
+            Fingerprint128Batch(inputs.data(), lengths.data(), out.data(), n);
+            for (size_t i = 0; i < n; i++) {
+                chunks[i].fingerprint = out[i];
+            }
+        }
+
+    }
+
+    void FingerprintChunks(const uint8_t *input, size_t length, std::vector<Chunk> &chunks, const ChunkSizes &requested, ThreadPool &pool) {
+        const ChunkSizes sizes = Ordered(requested);
+        std::vector<Candidate> candidates;
+        Scan(input, length, MasksFor(sizes), pool, candidates);
+        size_t first = chunks.size();
+        Select(candidates, length, true, sizes, 0, chunks);
+        Chunk *found = chunks.data() + first;
+        size_t grain = std::max<size_t>(1, kFingerprintGrain / sizes.average);
+        pool.ParallelFor(0, chunks.size() - first, grain, [&](size_t begin, size_t end) {
+            FingerprintRange(input, 0, found + begin, end - begin);
+        });
+    }
+
+    void FingerprintChunks(const uint8_t *input, size_t length, std::vector<Chunk> &chunks, const ChunkSizes &sizes, unsigned threads) {
+        ThreadPool pool(length <= kSegment ? 1 : threads);
+        FingerprintChunks(input, length, chunks, sizes, pool);
+    }
+
+    // Batches are at least 8 MiB, and always hold several maximum-size chunks
+    // beyond the undecided one carried over from the previous batch.
+
+    Chunker::Chunker(const ChunkSizes &sizes, unsigned threads)
+        : sizes_(Ordered(sizes)), batch_size_(std::max<size_t>(8 * 1024 * 1024, 4 * sizes_.max)), own_pool_(new ThreadPool(threads)), pool_(*own_pool_), current_(0)
+    {
+        for (int i = 0; i < 2; i++) {
+            batches_[i].offset = 0;
+            batches_[i].tasks = 0;
+        }
+    }
+
+    Chunker::Chunker(const ChunkSizes &sizes, ThreadPool &pool)
+        : sizes_(Ordered(sizes)), batch_size_(std::max<size_t>(8 * 1024 * 1024, 4 * sizes_.max)), pool_(pool), current_(0)
+    {
+        for (int i = 0; i < 2; i++) {
+            batches_[i].offset = 0;
+            batches_[i].tasks = 0;
+        }
+    }
+
+    Chunker::~Chunker() {
+        std::vector<Chunk> ignored;
+        Finish(batches_[0], ignored);
+        Finish(batches_[1], ignored);
+    }
+
+    void Chunker::Update(const uint8_t *input, size_t length, std::vector<Chunk> &chunks) {
+        while (length > 0) {
+            std::vector<uint8_t> &buffer = batches_[current_].buffer;
+            if (buffer.capacity() < batch_size_) {
+                buffer.reserve(batch_size_);
+            }
+            size_t n = std::min(length, batch_size_ - buffer.size());
+            buffer.insert(buffer.end(), input, input + n);
+            input += n;
+            length -= n;
+            if (buffer.size() == batch_size_) {
+                Process(false, chunks);
+            }
+        }
+    }
+
+    void Chunker::Final(std::vector<Chunk> &chunks) {
+        Process(true, chunks);
+    }
+
+    // Find the chunks in the current batch and start fingerprinting them, then
+    // collect the previous batch's fingerprints and carry the undecided end of
+    // this batch over to the other buffer.
+
+    void Chunker::Process(bool final, std::vector<Chunk> &chunks) {
+
+        Batch &batch = batches_[current_], &other = batches_[current_ ^ 1];
+
+        std::vector<Candidate> candidates;
+        Scan(batch.buffer.data(), batch.buffer.size(), MasksFor(sizes_), pool_, candidates);
+
+        std::vector<Chunk> found;
+        size_t rest = Select(candidates, batch.buffer.size(), final, sizes_, batch.offset, found);
+
+        Finish(other, chunks);
+
+        batch.chunks.swap(found);
+        Launch(batch);
+
+        other.offset = batch.offset + rest;
+        other.buffer.assign(batch.buffer.begin() + rest, batch.buffer.end());
+        current_ ^= 1;
+
+        if (final) {
+            Finish(batch, chunks);
+        }
+
+    }
+
+    void Chunker::Launch(Batch &batch) {
+        size_t n = batch.chunks.size();
+        size_t grain = std::max<size_t>(1, kFingerprintGrain / sizes_.average);
+        batch.tasks = (n + grain - 1) / grain;
+        for (size_t begin = 0; begin < n; begin += grain) {
+            size_t count = std::min(grain, n - begin);
+            pool_.Submit([&batch, begin, count]() {
+                FingerprintRange(batch.buffer.data(), batch.offset, batch.chunks.data() + begin, count);
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                if (--batch.tasks == 0) {
+                    batch.done.notify_all();
+                }
+            });
+        }
+    }
+
+    void Chunker::Finish(Batch &batch, std::vector<Chunk> &chunks) {
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        while (batch.tasks > 0) {
+            batch.done.wait(lock);
+        }
+        chunks.insert(chunks.end(), batch.chunks.begin(), batch.chunks.end());
+        batch.chunks.clear();
+    }
+
+}
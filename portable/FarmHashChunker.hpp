@@ -0,0 +1,133 @@
+// Content-defined chunking, with a `Fingerprint128` for every chunk.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Chunk boundaries are chosen by the content, as in FastCDC, so that inserting
+// or deleting bytes only changes the chunks around the edit.  A chunk ends
+// where a Gear rolling hash of the 64 bytes before the end has enough zero
+// high bits: `log2(average) + 2` of them up to the average size and
+// `log2(average) - 2` after it ("normalized chunking"), never before the
+// minimum size and always at the maximum.  Since the hash only sees those 64
+// bytes, the input is scanned for candidate ends in parallel and the
+// boundaries picked from them afterwards, giving exactly what a sequential
+// scan would.
+//
+// The boundaries depend on the input, the sizes and `kChunkerVersion` only
+// (not on how the input is split across `Update()` calls, nor on the number of
+// threads).  Any change to the construction above must bump the version.
+//
+//     FarmHash::Chunker chunker;
+//     std::vector<FarmHash::Chunk> chunks;
+//     while (...) chunker.Update(buffer, n, chunks);
+//     chunker.Final(chunks);
+//
+// `Chunker` collects its input into 8 MiB batches.  Each batch is scanned on
+// the pool and its chunks are fingerprinted there while the caller goes on to
+// read the next batch, so chunks come out (in order) one batch behind.
+//
+#ifndef FARM_HASH_CHUNKER_HPP
+#define FARM_HASH_CHUNKER_HPP
+
+#include "FarmHash.hpp"
+#include "ThreadPool.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace FarmHash {
+
+    const uint32_t kChunkerVersion = 1;
+
+    struct Chunk {
+        uint64_t offset;
+        uint64_t length;
+        UInt128 fingerprint;
+    };
+
+    // Used as `64 <= min <= average <= max`: a smaller `min` is raised to 64, and
+    // an `average` or `max` below the size before it raised to that size.
+    // `average` is then rounded down to a power of two.
+
+    struct ChunkSizes {
+        size_t min, average, max;
+        ChunkSizes(size_t min = 2 * 1024, size_t average = 8 * 1024, size_t max = 64 * 1024) : min(min), average(average), max(max) {}
+    };
+
+    // Chunk and fingerprint a whole buffer in place.  With `threads == 0`, one
+    // thread per core.
+
+    void FingerprintChunks(const uint8_t *input, size_t length, std::vector<Chunk> &chunks, const ChunkSizes &sizes = ChunkSizes(), unsigned threads = 0);
+
+    void FingerprintChunks(const uint8_t *input, size_t length, std::vector<Chunk> &chunks, const ChunkSizes &sizes, ThreadPool &pool);
+
+    class Chunker {
+
+    public:
+
+        explicit Chunker(const ChunkSizes &sizes = ChunkSizes(), unsigned threads = 0);
+        Chunker(const ChunkSizes &sizes, ThreadPool &pool);
+        ~Chunker();
+
+        Chunker(const Chunker &) = delete;
+        Chunker &operator=(const Chunker &) = delete;
+
+        // Both append the chunks completed so far to `chunks`.  Nothing may be
+        // passed to `Update()` after `Final()`.
+
+        void Update(const uint8_t *input, size_t length, std::vector<Chunk> &chunks);
+        void Update(const int8_t *input, size_t length, std::vector<Chunk> &chunks) { Update((uint8_t *)input, length, chunks); }
+
+        void Final(std::vector<Chunk> &chunks);
+
+    private:
+
+        // Input waiting to be chunked, and the chunks found in it last time
+        // round, which are fingerprinted from it in the background.
+
+        struct Batch {
+            uint64_t offset;       // of the start of 'buffer' in the input
+            std::vector<uint8_t> buffer;
+            std::vector<Chunk> chunks;
+            size_t tasks;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+
+        void Process(bool final, std::vector<Chunk> &chunks);
+        void Launch(Batch &batch);
+        void Finish(Batch &batch, std::vector<Chunk> &chunks);
+
+        ChunkSizes sizes_;
+        size_t batch_size_;
+        std::unique_ptr<ThreadPool> own_pool_;
+        ThreadPool &pool_;
+        Batch batches_[2];
+        size_t current_;           // the batch being filled
+
+    };
+
+}
+
+#endif // ! FARM_HASH_CHUNKER_HPP
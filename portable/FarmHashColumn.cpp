@@ -0,0 +1,88 @@
+// `Fingerprint128` of every string in an Arrow-style column.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Fingerprints the strings of a column laid out as in Apache Arrow: one buffer
+// of bytes, and `rows + 1` offsets into it.  Each row is hashed by the generic
+// `Fingerprint128()`; what the column adds is that the bytes of rows a little
+// way ahead are prefetched while the current one is hashed, which hides the
+// cache misses of columns too large for the cache.
+//
+// Hashing short strings in the lanes of a vector, sorted by which path of
+// `CityMurmur()` their length takes, was tried and is not worth it: sorting
+// costs about as much as hashing, and the per-lane loads eat what is left.
+//
+// Nor does interleaving several rows' scalar `CityMurmur()` in one loop, so
+// that their multiply chains overlap: the core already overlaps consecutive
+// independent rows on its own.  Measured on 4096-row columns (ns per row,
+// interleaved against one row at a time):
+//
+//     4 rows of 33-127 bytes, finished lanes masked     40.3 against 23.5
+//     the same, rows binned so that no lane idles        28.5 against 20.0
+//     2 rows of 33-127 bytes                             29.0 against 18.6
+//     4 rows of 8-15 bytes, inlined `HashLen0to16()`      7.8 against 8.2,
+//                         and 8.1 for one row at a time with the same inlining
+//
+#include "FarmHash.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    namespace {
+
+        // How many rows ahead to prefetch: far enough for a miss to complete
+        // while the rows in between are hashed.
+
+        const size_t kPrefetchRows = 16;
+
+        template <typename Offset>
+        inline void HashColumn(const uint8_t *data, const Offset *offsets, size_t rows, UInt128 *out) {
+            size_t ahead = std::min(rows, kPrefetchRows);
+            for (size_t i = 0; i < ahead; i++) {
+                Prefetch(data + offsets[i]);
+            }
+            for (size_t i = 0; i < rows; i++) {
+                if (i + kPrefetchRows < rows) {
+                    Prefetch(data + offsets[i + kPrefetchRows]);
+                }
+                out[i] = Fingerprint128(data + offsets[i], offsets[i + 1] - offsets[i]);
+            }
+        }
+
+    }
+
+    void Fingerprint128Column(const uint8_t *data, const uint32_t *offsets, size_t rows, UInt128 *out) {
+        HashColumn(data, offsets, rows, out);
+    }
+
+    void Fingerprint128Column(const uint8_t *data, const uint64_t *offsets, size_t rows, UInt128 *out) {
+        HashColumn(data, offsets, rows, out);
+    }
+
+}
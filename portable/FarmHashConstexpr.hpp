@@ -0,0 +1,70 @@
+// A compile-time `Fingerprint128`, for string literals and other constant keys.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// `Fingerprint128Constexpr()` gives the same result as `Fingerprint128()`.
+// In a constant expression it runs the reference arithmetic with byte-wise
+// loads; at run time it simply calls `Fingerprint128()`.  Both need C++14 and
+// a compiler with `std::is_constant_evaluated()` or its builtin (GCC 9,
+// Clang 9, MSVC 19.25 in C++20 mode); `FARM_HASH_HAS_CONSTEXPR` says whether
+// that is the case, and without it this is only a run-time function.
+//
+//     using namespace FarmHash::literals;
+//
+//     switch (UInt128Low64(FarmHash::Fingerprint128(name))) {
+//         case UInt128Low64("content-type"_fp128): ...
+//         case UInt128Low64("content-length"_fp128): ...
+//     }
+//
+#ifndef FARM_HASH_CONSTEXPR_HPP
+#define FARM_HASH_CONSTEXPR_HPP
+
+#include "FarmHash.hpp"
+#include "FarmHashDetail.hpp"
+
+namespace FarmHash {
+
+    template <typename Byte>
+    FARM_HASH_CONSTEXPR UInt128 Fingerprint128Constexpr(const Byte *input, size_t length) {
+        static_assert(sizeof(Byte) == 1, "elements of 'input' must have a size equal to one");
+        if (detail::IsConstantEvaluated()) {
+            return detail::CityHash128Impl(input, length);
+        }
+        return Fingerprint128(reinterpret_cast<const uint8_t *>(input), length);
+    }
+
+#if FARM_HASH_HAS_CONSTEXPR
+
+    namespace literals {
+
+        constexpr UInt128 operator""_fp128(const char *input, size_t length) {
+            return Fingerprint128Constexpr(input, length);
+        }
+
+    }
+
+#endif
+
+}
+
+#endif // ! FARM_HASH_CONSTEXPR_HPP
@@ -0,0 +1,424 @@
+// Internal building blocks shared by the `FarmHash` translation units.
+//
+// Copyright (c) 2014 Google, Inc.
+//
+// Numerous Modifications and Optimizations
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Nothing in here is part of the public interface; it exists so that the
+// batch, streaming and other variants of `Fingerprint128` can share the exact
+// arithmetic of the reference implementation in `FarmHash.cpp`.
+//
+#ifndef FARM_HASH_DETAIL_HPP
+#define FARM_HASH_DETAIL_HPP
+
+#include "Endian.hpp"
+#include "UInt128.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+// ---------------------------------------------------------------------
+// Everything below is `constexpr` when the compiler can tell a constant
+// evaluation from a run-time one (C++14 or later, plus either C++20's
+// `std::is_constant_evaluated()` or the builtin it is made of), so that the
+// run-time path can keep using `std::memcpy` and friends.  Otherwise it is
+// all plain `inline`, exactly as before.
+
+#if defined(_MSVC_LANG)
+#   define FARM_HASH_CPLUSPLUS _MSVC_LANG
+#else
+#   define FARM_HASH_CPLUSPLUS __cplusplus
+#endif
+
+#if defined(__has_builtin)
+#   if __has_builtin(__builtin_is_constant_evaluated)
+#       define FARM_HASH_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#   endif
+#endif
+
+#if !defined(FARM_HASH_IS_CONSTANT_EVALUATED)
+#   if defined(__cpp_lib_is_constant_evaluated)
+#       define FARM_HASH_IS_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#   elif defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9
+#       define FARM_HASH_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#   endif
+#endif
+
+#if FARM_HASH_CPLUSPLUS >= 201402L && defined(FARM_HASH_IS_CONSTANT_EVALUATED)
+#   define FARM_HASH_HAS_CONSTEXPR 1
+#   define FARM_HASH_CONSTEXPR constexpr
+#else
+#   define FARM_HASH_HAS_CONSTEXPR 0
+#   define FARM_HASH_CONSTEXPR inline
+#endif
+
+namespace FarmHash {
+
+    namespace detail {
+
+        // Give hints to the optimizer (even though humans are notoriously bad at doing so).
+
+        #if defined(__GNUC__) || defined(__clang__) || defined(__INTEL_COMPILER)
+
+            FARM_HASH_CONSTEXPR bool IsLikely  ( const bool x ) { return __builtin_expect(x, true ); }
+            FARM_HASH_CONSTEXPR bool IsUnlikely( const bool x ) { return __builtin_expect(x, false); }
+
+            inline void Prefetch( const void *p ) { __builtin_prefetch(p); }
+
+        #else
+
+            FARM_HASH_CONSTEXPR bool IsLikely  ( const bool x ) { return x; }
+            FARM_HASH_CONSTEXPR bool IsUnlikely( const bool x ) { return x; }
+
+            inline void Prefetch( const void * ) {}
+
+        #endif
+
+        FARM_HASH_CONSTEXPR bool IsConstantEvaluated() {
+        #if FARM_HASH_HAS_CONSTEXPR
+            return FARM_HASH_IS_CONSTANT_EVALUATED();
+        #else
+            return false;
+        #endif
+        }
+
+        // Byte-order independent fetching.  The hashing functions below are templates
+        // on the byte type only so that string literals can be hashed at compile
+        // time, where a `char *` cannot be reinterpreted as a `uint8_t *`.
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR uint64_t Fetch64(const Byte *p) {
+            if (IsConstantEvaluated()) {
+                uint64_t result = 0;
+                for (int i = 7; i >= 0; i--) {
+                    result = (result << 8) | static_cast<uint8_t>(p[i]);
+                }
+                return result;
+            }
+            uint64_t result = 0;
+            std::memcpy(&result, p, sizeof(result));
+            return uint64_in_little_endian_order(result);
+        }
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR uint32_t Fetch32(const Byte *p) {
+            if (IsConstantEvaluated()) {
+                uint32_t result = 0;
+                for (int i = 3; i >= 0; i--) {
+                    result = (result << 8) | static_cast<uint8_t>(p[i]);
+                }
+                return result;
+            }
+            uint32_t result = 0;
+            std::memcpy(&result, p, sizeof(result));
+            return uint32_in_little_endian_order(result);
+        }
+
+        // Cyclical rotation of unsigned integers.
+
+        #if defined(_MSC_VER) && !FARM_HASH_HAS_CONSTEXPR
+
+         // inline uint32_t RotateRight32(uint32_t value, int shift) { return _rotr  (value, shift); }
+            inline uint64_t RotateRight64(uint64_t value, int shift) { return _rotr64(value, shift); }
+
+        #else // modern compilers automatically get this right, with no 'undefined' behaviour (https://goo.gl/ZsFpuz)
+
+         // inline uint32_t RotateRight32(uint32_t value, unsigned shift) { shift &= 31; return (value >> shift) | (value << (32 - shift)); }
+            FARM_HASH_CONSTEXPR uint64_t RotateRight64(uint64_t value, unsigned shift) { shift &= 63; return (value >> shift) | (value << (64 - shift)); }
+
+        #endif
+
+        // `std::swap()` is not `constexpr` until C++20.
+
+        FARM_HASH_CONSTEXPR void Swap(uint64_t &a, uint64_t &b) {
+            uint64_t t = a;
+            a = b;
+            b = t;
+        }
+
+        // Some primes between 2^63 and 2^64 for various uses.
+
+        const uint64_t k0 = 0xc3a5c85c97cb3127ULL;
+        const uint64_t k1 = 0xb492b66fbe98f273ULL;
+        const uint64_t k2 = 0x9ae16a3b2f90404fULL;
+
+        // Murmur-inspired hashing and suboperations.
+
+        FARM_HASH_CONSTEXPR uint64_t Hash128to64(UInt128 x) {
+            const uint64_t kMul = 0x9ddfea08eb382d69ULL;
+            uint64_t a = (UInt128Low64(x) ^ UInt128High64(x)) * kMul;
+            a ^= (a >> 47);
+            uint64_t b = (UInt128High64(x) ^ a) * kMul;
+            b ^= (b >> 47);
+            b *= kMul;
+            return b;
+        }
+
+        FARM_HASH_CONSTEXPR uint64_t ShiftMix(uint64_t value) {
+            return value ^ (value >> 47);
+        }
+
+        FARM_HASH_CONSTEXPR uint64_t HashLen16(uint64_t u, uint64_t v) {
+            return Hash128to64(UInt128(u, v));
+        }
+
+        FARM_HASH_CONSTEXPR uint64_t HashLen16(uint64_t u, uint64_t v, uint64_t mul) {
+            uint64_t a = (u ^ v) * mul;
+            a ^= (a >> 47);
+            uint64_t b = (v ^ a) * mul;
+            b ^= (b >> 47);
+            b *= mul;
+            return b;
+        }
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR uint64_t HashLen0to16(const Byte *s, size_t len) {
+            if (len >= 8) {
+                uint64_t mul = k2 + len * 2;
+                uint64_t a = Fetch64(s) + k2;
+                uint64_t b = Fetch64(s + len - 8);
+                uint64_t c = RotateRight64(b, 37) * mul + a;
+                uint64_t d = (RotateRight64(a, 25) + b) * mul;
+                return HashLen16(c, d, mul);
+            }
+            if (len >= 4) {
+                uint64_t mul = k2 + len * 2;
+                uint64_t a = Fetch32(s);
+                return HashLen16(len + (a << 3), Fetch32(s + len - 4), mul);
+            }
+            if (len > 0) {
+                uint8_t a = s[0];
+                uint8_t b = s[len >> 1];
+                uint8_t c = s[len - 1];
+                uint32_t y = static_cast<uint32_t>(a) + (static_cast<uint32_t>(b) << 8);
+                uint32_t z = len + (static_cast<uint32_t>(c) << 2);
+                return ShiftMix(y * k2 ^ z * k0) * k2;
+            }
+            return k2;
+        }
+
+        // Like `std::pair<uint64_t,uint64_t>`, but assignable in a constant expression.
+
+        struct Pair64 {
+            uint64_t first, second;
+        };
+
+        // Return a 16-byte hash for 48 bytes.  Quick and dirty.
+        // Callers do best to use "random-looking" value for a and b.
+
+        FARM_HASH_CONSTEXPR Pair64 WeakHashLen32WithSeeds(uint64_t w, uint64_t x, uint64_t y, uint64_t z, uint64_t a, uint64_t b) {
+            a += w;
+            b = RotateRight64(b + a + z, 21);
+            uint64_t c = a;
+            a += x;
+            a += y;
+            b += RotateRight64(a, 44);
+            Pair64 result = { a + z, b + c };
+            return result;
+        }
+
+        // Return a 16-byte hash for s[0] ... s[31], a, and b.  Quick and dirty.
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR Pair64 WeakHashLen32WithSeeds(const Byte *s, uint64_t a, uint64_t b) {
+            return WeakHashLen32WithSeeds(Fetch64(s), Fetch64(s + 8), Fetch64(s + 16), Fetch64(s + 24), a, b);
+        }
+
+        // A subroutine for CityHash128().  Returns a decent 128-bit hash for strings
+        // of any length representable in signed long.  Based on City and Murmur.
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR UInt128 CityMurmur(const Byte *s, size_t len, UInt128 seed) {
+            uint64_t a = UInt128Low64(seed);
+            uint64_t b = UInt128High64(seed);
+            uint64_t c = 0;
+            uint64_t d = 0;
+            signed long l = len - 16;
+            if (l <= 0) {  // len <= 16
+                a = ShiftMix(a * k1) * k1;
+                c = b * k1 + HashLen0to16(s, len);
+                d = ShiftMix(a + (len >= 8 ? Fetch64(s) : c));
+            } else {  // len > 16
+                c = HashLen16(Fetch64(s + len - 8) + k1, a);
+                d = HashLen16(b + len, c + Fetch64(s + len - 16));
+                a += d;
+                do {
+                    a ^= ShiftMix(Fetch64(s) * k1) * k1;
+                    a *= k1;
+                    b ^= a;
+                    c ^= ShiftMix(Fetch64(s + 8) * k1) * k1;
+                    c *= k1;
+                    d ^= c;
+                    s += 16;
+                    l -= 16;
+                } while (l > 0);
+            }
+            a = HashLen16(a, c);
+            b = HashLen16(d, b);
+            return UInt128(a ^ b, HashLen16(b, a));
+        }
+
+        // The `len >= 128` path of CityHash128WithSeed(), split into its three
+        // phases so that callers which do not hold the whole input in one place
+        // (or which run several inputs side by side) can drive it themselves.
+        //
+        // Keep 56 bytes of state: v, w, x, y, and z.
+
+        struct CityHash128State {
+            Pair64 v, w;
+            uint64_t x, y, z;
+        };
+
+        // Seed the state.  Needs the total length (which must be at least 128)
+        // and the first 128-byte block, of which only s[0..15] and s[88..95] are read.
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR void CityHash128Begin(CityHash128State &st, const Byte *s, size_t len, UInt128 seed) {
+            st.x = UInt128Low64(seed);
+            st.y = UInt128High64(seed);
+            st.z = len * k1;
+            st.v.first = RotateRight64(st.y ^ k1, 49) * k1 + Fetch64(s);
+            st.v.second = RotateRight64(st.v.first, 42) * k1 + Fetch64(s + 8);
+            st.w.first = RotateRight64(st.y + st.z, 35) * k1 + st.x;
+            st.w.second = RotateRight64(st.x + Fetch64(s + 88), 53) * k1;
+        }
+
+        // One iteration of the main loop, consuming s[0..127].  This is the same
+        // inner loop as CityHash64(), manually unrolled.
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR void CityHash128Block(CityHash128State &st, const Byte *s) {
+            uint64_t x = st.x, y = st.y, z = st.z;
+            Pair64 v = st.v, w = st.w;
+            x = RotateRight64(x + y + v.first + Fetch64(s + 8), 37) * k1;
+            y = RotateRight64(y + v.second + Fetch64(s + 48), 42) * k1;
+            x ^= w.second;
+            y += v.first + Fetch64(s + 40);
+            z = RotateRight64(z + w.first, 33) * k1;
+            v = WeakHashLen32WithSeeds(s, v.second * k1, x + w.first);
+            w = WeakHashLen32WithSeeds(s + 32, z + w.second, y + Fetch64(s + 16));
+            Swap(z, x);
+            s += 64;
+            x = RotateRight64(x + y + v.first + Fetch64(s + 8), 37) * k1;
+            y = RotateRight64(y + v.second + Fetch64(s + 48), 42) * k1;
+            x ^= w.second;
+            y += v.first + Fetch64(s + 40);
+            z = RotateRight64(z + w.first, 33) * k1;
+            v = WeakHashLen32WithSeeds(s, v.second * k1, x + w.first);
+            w = WeakHashLen32WithSeeds(s + 32, z + w.second, y + Fetch64(s + 16));
+            Swap(z, x);
+            st.x = x; st.y = y; st.z = z;
+            st.v = v; st.w = w;
+        }
+
+        // Finish the hash, given the remaining `len < 128` bytes at `s`.  Note
+        // that the tail is read *backwards* from `s + len` in chunks of 32 bytes,
+        // so up to 128 bytes before `s + len` must be readable (these will be
+        // bytes already consumed by the main loop when `len` is not a multiple of 32).
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR UInt128 CityHash128End(const CityHash128State &st, const Byte *s, size_t len) {
+            uint64_t x = st.x, y = st.y, z = st.z;
+            Pair64 v = st.v, w = st.w;
+
+            x += RotateRight64(v.first + z, 49) * k0;
+            y = y * k0 + RotateRight64(w.second, 37);
+            z = z * k0 + RotateRight64(w.first, 27);
+            w.first *= 9;
+            v.first *= k0;
+
+            // If 0 < len < 128, hash up to 4 chunks of 32 bytes each from the end of s.
+
+            for (size_t tail_done = 0; tail_done < len; ) {
+                tail_done += 32;
+                y = RotateRight64(x + y, 42) * k0 + v.second;
+                w.first += Fetch64(s + len - tail_done + 16);
+                x = x * k0 + w.first;
+                z += w.second + Fetch64(s + len - tail_done);
+                w.second += v.first;
+                v = WeakHashLen32WithSeeds(s + len - tail_done, v.first + z, v.second);
+                v.first *= k0;
+            }
+
+            // At this point our 56 bytes of state should contain more than
+            // enough information for a strong 128-bit hash.  We use two
+            // different 56-byte-to-8-byte hashes to get a 16-byte final result.
+
+            x = HashLen16(x, v.first);
+            y = HashLen16(y + z, w.first);
+
+            return UInt128(HashLen16(x + v.second, w.second) + y, HashLen16(x + w.second, y + v.second));
+        }
+
+        // CityHash128() consumes the first 16 bytes (if there are that many) as
+        // the seed for CityHash128WithSeed().  Returns the seed and advances `s` and `len`.
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR UInt128 CityHash128Seed(const Byte *&s, size_t &len) {
+            if (len >= 16) {
+                UInt128 seed(Fetch64(s), Fetch64(s + 8) + k0);
+                s += 16;
+                len -= 16;
+                return seed;
+            }
+            return UInt128(k0, k1);
+        }
+
+        // The whole of CityHash128WithSeed() and CityHash128(), as used by
+        // `FarmHash.cpp` and by the compile-time `Fingerprint128Constexpr()`.
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR UInt128 CityHash128WithSeedImpl(const Byte *s, size_t len, UInt128 seed) {
+
+            // We expect len >= 128 to be the common case.
+
+            if (IsUnlikely(len < 128)) {
+                return CityMurmur(s, len, seed);
+            }
+
+            CityHash128State st = {};
+            CityHash128Begin(st, s, len, seed);
+
+            do {
+                CityHash128Block(st, s);
+                s += 128;
+                len -= 128;
+            } while (IsLikely(len >= 128));
+
+            return CityHash128End(st, s, len);
+
+        }
+
+        template <typename Byte>
+        FARM_HASH_CONSTEXPR UInt128 CityHash128Impl(const Byte *s, size_t len) {
+            UInt128 seed = CityHash128Seed(s, len);
+            return CityHash128WithSeedImpl(s, len, seed);
+        }
+
+    }
+
+}
+
+#endif // ! FARM_HASH_DETAIL_HPP
@@ -0,0 +1,449 @@
+// Fingerprinting of files and file descriptors without reading them into memory first.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FarmHashFile.hpp"
+#include "FarmHashStream.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    namespace {
+
+        // Files up to this size are cheaper to read (onto the stack) than to map.
+
+        const size_t kSmallFile = 16 * 1024;
+
+        // Each of the two 'pread' buffers; a multiple of any sane page size.
+
+        const size_t kChunk = 1024 * 1024;
+        const size_t kAlignment = 4096;
+
+        // Files from this size on are read in parallel, given a pool, in
+        // segments of 'kSegment'.
+
+        const uint64_t kParallelFile = 64 * 1024 * 1024;
+        const size_t kSegment = 4 * 1024 * 1024;
+
+        // Segments in flight at once across all parallel reads in the process,
+        // however many files are being fingerprinted concurrently.  A read that
+        // cannot get at least two falls back to reading sequentially.
+
+        const size_t kSegmentBudget = 32;
+
+        std::mutex budget_mutex;
+        size_t budget = kSegmentBudget;
+
+        size_t AcquireSegments(size_t wanted) {
+            std::lock_guard<std::mutex> lock(budget_mutex);
+            size_t n = std::min(wanted, budget);
+            budget -= n;
+            return n;
+        }
+
+        void ReleaseSegments(size_t n) {
+            std::lock_guard<std::mutex> lock(budget_mutex);
+            budget += n;
+        }
+
+        // Read exactly 'length' bytes at 'offset', unless end-of-file comes first.
+
+        ssize_t ReadFully(int fd, uint8_t *buffer, size_t length, off_t offset) {
+            size_t done = 0;
+            while (done < length) {
+                ssize_t n = offset < 0 ? read(fd, buffer + done, length - done) : pread(fd, buffer + done, length - done, offset + done);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return -1;
+                }
+                if (n == 0) {
+                    break;
+                }
+                done += n;
+            }
+            return done;
+        }
+
+        struct AlignedBuffer {
+            uint8_t *data;
+            explicit AlignedBuffer(size_t size) : data(0) {
+                void *p;
+                if (posix_memalign(&p, kAlignment, size) == 0) {
+                    data = static_cast<uint8_t *>(p);
+                }
+            }
+            ~AlignedBuffer() { std::free(data); }
+        };
+
+        bool FingerprintMapped(int fd, size_t size, UInt128 &fingerprint) {
+            void *p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                return false;
+            }
+        #if defined(MADV_SEQUENTIAL)
+            madvise(p, size, MADV_SEQUENTIAL);
+        #endif
+        #if defined(MADV_HUGEPAGE)
+            madvise(p, size, MADV_HUGEPAGE); // only honoured by file-backed THP-capable kernels, harmless otherwise
+        #endif
+            fingerprint = Fingerprint128(static_cast<const uint8_t *>(p), size);
+            munmap(p, size);
+            return true;
+        }
+
+        bool FingerprintUnsized(int fd, UInt128 &fingerprint) {
+            AlignedBuffer buffer(kChunk);
+            if (!buffer.data) {
+                errno = ENOMEM;
+                return false;
+            }
+            Fingerprint128Stream stream;
+            for (;;) {
+                ssize_t n = ReadFully(fd, buffer.data, kChunk, -1);
+                if (n < 0) {
+                    return false;
+                }
+                if (n == 0) {
+                    break;
+                }
+                stream.Update(buffer.data, n);
+            }
+            if (!stream.Complete()) {
+                errno = EIO;
+                return false;
+            }
+            fingerprint = stream.Final();
+            return true;
+        }
+
+        // A ring of segment buffers, each being read by a task (or by the hashing
+        // thread) or waiting to be hashed.  Queued tasks hold on to it, so it
+        // outlives an early return; they find their slot taken and do nothing.
+
+        struct ParallelRead {
+
+            enum { kQueued, kReading, kRead, kAbandoned };
+
+            struct Slot {
+                std::atomic<int> state;
+                uint64_t offset;
+                size_t length;
+                ssize_t result;
+                int error;
+            };
+
+            int fd;
+            size_t window;          // segments taken from the budget
+            AlignedBuffer buffer;
+            std::unique_ptr<Slot[]> slots;
+            std::mutex mutex;
+            std::condition_variable read;
+
+            // Slots not yet submitted count as abandoned, so an early return
+            // never waits on them.
+
+            ParallelRead(int fd, size_t window) : fd(fd), window(window), buffer(window * kSegment), slots(new Slot[window]) {
+                for (size_t i = 0; i < window; i++) {
+                    slots[i].state = kAbandoned;
+                }
+            }
+
+            ~ParallelRead() { ReleaseSegments(window); }
+
+            // Read 'slot' unless someone else has already started to.
+
+            void Claim(size_t i) {
+                Slot &slot = slots[i];
+                int queued = kQueued;
+                if (!slot.state.compare_exchange_strong(queued, kReading)) {
+                    return;
+                }
+                slot.result = ReadFully(fd, buffer.data + i * kSegment, slot.length, slot.offset);
+                slot.error = errno;
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.state = kRead;
+                read.notify_all();
+            }
+
+            void Wait(size_t i) {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (slots[i].state != kRead) {
+                    read.wait(lock);
+                }
+            }
+
+        };
+
+        // 'window' segments have been taken from the budget; they are returned
+        // once the last queued task has let go of the buffers.
+
+        bool FingerprintParallel(int fd, uint64_t size, size_t window, ThreadPool &pool, UInt128 &fingerprint) {
+            std::shared_ptr<ParallelRead> state = std::make_shared<ParallelRead>(fd, window);
+            if (!state->buffer.data) {
+                errno = ENOMEM;
+                return false;
+            }
+        #if defined(POSIX_FADV_SEQUENTIAL)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        #endif
+            uint64_t segments = (size + kSegment - 1) / kSegment;
+            auto submit = [&](uint64_t segment) {
+                size_t i = segment % window;
+                ParallelRead::Slot &slot = state->slots[i];
+                slot.offset = segment * kSegment;
+                slot.length = std::min<uint64_t>(kSegment, size - slot.offset);
+                slot.state = ParallelRead::kQueued;
+                pool.Submit([state, i]() { state->Claim(i); });
+            };
+            for (uint64_t segment = 0; segment < std::min<uint64_t>(window, segments); segment++) {
+                submit(segment);
+            }
+            Fingerprint128Stream stream(size);
+            bool ok = true;
+            for (uint64_t segment = 0; segment < segments && ok; segment++) {
+                size_t i = segment % window;
+                ParallelRead::Slot &slot = state->slots[i];
+                state->Claim(i);
+                state->Wait(i);
+                if (slot.result != static_cast<ssize_t>(slot.length)) {
+                    errno = slot.result < 0 ? slot.error : EIO; // or truncated while we were reading it
+                    ok = false;
+                    break;
+                }
+                stream.Update(state->buffer.data + i * kSegment, slot.length);
+                if (segment + window < segments) {
+                    submit(segment + window);
+                }
+            }
+            if (!ok) {
+
+                // No read may be left running on 'fd' once we return.
+
+                int saved = errno;
+                for (size_t i = 0; i < window; i++) {
+                    int queued = ParallelRead::kQueued;
+                    if (!state->slots[i].state.compare_exchange_strong(queued, ParallelRead::kAbandoned) && queued == ParallelRead::kReading) {
+                        state->Wait(i);
+                    }
+                }
+                errno = saved;
+                return false;
+            }
+            if (!stream.Complete()) {
+                errno = EIO;
+                return false;
+            }
+            fingerprint = stream.Final();
+            return true;
+        }
+
+    }
+
+    namespace detail {
+
+        // One reader thread fills each half of the buffer in turn, a chunk at a
+        // time, while the caller hashes the other half.
+
+        bool FingerprintFdSized(int fd, uint64_t size, UInt128 &fingerprint) {
+            AlignedBuffer buffer(2 * kChunk);
+            if (!buffer.data) {
+                errno = ENOMEM;
+                return false;
+            }
+        #if defined(POSIX_FADV_SEQUENTIAL)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        #endif
+            uint64_t chunks = (size + kChunk - 1) / kChunk;
+            std::mutex mutex;
+            std::condition_variable changed;
+            ssize_t result[2];
+            int error[2];
+            bool full[2] = { false, false };
+            bool stop = false;
+
+            std::thread reader([&]() {
+                for (uint64_t c = 0; c < chunks; c++) {
+                    size_t i = c % 2;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        while (full[i] && !stop) {
+                            changed.wait(lock);
+                        }
+                        if (stop) {
+                            return;
+                        }
+                    }
+                    size_t length = std::min<uint64_t>(kChunk, size - c * kChunk);
+                    ssize_t n = ReadFully(fd, buffer.data + i * kChunk, length, c * kChunk);
+                    int e = errno;
+                    std::lock_guard<std::mutex> lock(mutex);
+                    result[i] = n;
+                    error[i] = e;
+                    full[i] = true;
+                    changed.notify_all();
+                    if (n != static_cast<ssize_t>(length)) {
+                        return; // the caller stops here too
+                    }
+                }
+            });
+
+            Fingerprint128Stream stream(size);
+            bool ok = true;
+            for (uint64_t c = 0; c < chunks; c++) {
+                size_t i = c % 2;
+                size_t length = std::min<uint64_t>(kChunk, size - c * kChunk);
+                ssize_t n;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!full[i]) {
+                        changed.wait(lock);
+                    }
+                    n = result[i];
+                    errno = error[i];
+                }
+                if (n != static_cast<ssize_t>(length)) {
+                    if (n >= 0) {
+                        errno = EIO; // truncated while we were reading it
+                    }
+                    ok = false;
+                    break;
+                }
+                stream.Update(buffer.data + i * kChunk, n);
+                std::lock_guard<std::mutex> lock(mutex);
+                full[i] = false;
+                changed.notify_all();
+            }
+
+            int saved = errno;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+                changed.notify_all();
+            }
+            reader.join();
+            errno = saved;
+
+            if (ok && !stream.Complete()) {
+                errno = EIO;
+                ok = false;
+            }
+            if (ok) {
+                fingerprint = stream.Final();
+            }
+            return ok;
+        }
+
+    }
+
+    bool FingerprintFd(int fd, UInt128 &fingerprint) {
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+
+        // Some regular files (e.g. in '/proc') claim to be empty but are not.
+
+        if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+            return FingerprintUnsized(fd, fingerprint);
+        }
+
+        uint64_t size = st.st_size;
+
+        if (size <= kSmallFile) {
+            uint8_t buffer[kSmallFile];
+            ssize_t n = ReadFully(fd, buffer, size, 0);
+            if (n != static_cast<ssize_t>(size)) {
+                if (n >= 0) {
+                    errno = EIO; // truncated while we were reading it
+                }
+                return false;
+            }
+            fingerprint = Fingerprint128(buffer, n);
+            return true;
+        }
+
+        if (size <= SIZE_MAX && FingerprintMapped(fd, size, fingerprint)) {
+            return true;
+        }
+
+        return detail::FingerprintFdSized(fd, size, fingerprint);
+
+    }
+
+    bool FingerprintFd(int fd, UInt128 &fingerprint, ThreadPool &pool) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        if (S_ISREG(st.st_mode) && static_cast<uint64_t>(st.st_size) >= kParallelFile) {
+            size_t window = AcquireSegments(pool.Size() + 2);
+            if (window >= 2) {
+                return FingerprintParallel(fd, st.st_size, window, pool, fingerprint);
+            }
+            ReleaseSegments(window);
+        }
+        return FingerprintFd(fd, fingerprint);
+    }
+
+    bool FingerprintFile(const char *path, UInt128 &fingerprint) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = FingerprintFd(fd, fingerprint);
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return ok;
+    }
+
+    bool FingerprintFile(const char *path, UInt128 &fingerprint, ThreadPool &pool) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = FingerprintFd(fd, fingerprint, pool);
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return ok;
+    }
+
+}
@@ -0,0 +1,83 @@
+// Fingerprinting of files and file descriptors without reading them into memory first.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Regular files are memory-mapped and hashed in place; files that cannot be
+// mapped are read with large aligned `pread` calls by one reader thread, one
+// buffer being filled while the other is hashed.  Pipes, sockets and character devices are read
+// sequentially to end-of-file.  Either way the result is `Fingerprint128()`
+// of the file contents.
+//
+// `Fingerprint128()` needs the length before it can start, so inputs whose
+// length is unknown -- pipes, sockets, devices, and regular files reporting a
+// size of zero -- are held in memory in full until end-of-file: O(n) memory,
+// where regular files take O(1).
+//
+// Given a `ThreadPool`, regular files of 64 MiB or more are instead read a few
+// megabytes at a time by tasks on the pool, several reads in flight at once,
+// while the calling thread hashes what has arrived in order.  That keeps deep
+// storage queues busy where one sequential reader cannot.  The caller may be a
+// task on the same pool: it does any read no worker has started yet itself.
+// Segment buffers come from one budget shared by every such read in the
+// process (128 MiB); a file that finds it spent is read sequentially.
+//
+// POSIX only.  All the functions return `false`, with `errno` set, on failure.
+//
+#ifndef FARM_HASH_FILE_HPP
+#define FARM_HASH_FILE_HPP
+
+#include "FarmHash.hpp"
+#include "ThreadPool.hpp"
+
+#include <string>
+
+namespace FarmHash {
+
+    bool FingerprintFile(const char *path, UInt128 &fingerprint);
+
+    inline bool FingerprintFile(const std::string &path, UInt128 &fingerprint) { return FingerprintFile(path.c_str(), fingerprint); }
+
+    // Regular files are hashed in full, regardless of the current offset of `fd`;
+    // anything else is hashed from its current position up to end-of-file.
+    // The descriptor is not closed.
+
+    bool FingerprintFd(int fd, UInt128 &fingerprint);
+
+    bool FingerprintFile(const char *path, UInt128 &fingerprint, ThreadPool &pool);
+
+    inline bool FingerprintFile(const std::string &path, UInt128 &fingerprint, ThreadPool &pool) { return FingerprintFile(path.c_str(), fingerprint, pool); }
+
+    bool FingerprintFd(int fd, UInt128 &fingerprint, ThreadPool &pool);
+
+    namespace detail {
+
+        // The `pread` path on its own, as taken for a regular file of `size`
+        // bytes that cannot be mapped; for tests.
+
+        bool FingerprintFdSized(int fd, uint64_t size, UInt128 &fingerprint);
+
+    }
+
+}
+
+#endif // ! FARM_HASH_FILE_HPP
@@ -0,0 +1,233 @@
+// `Fingerprint128` of fixed-size keys, specialized for their length at compile time.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// `Fingerprint128<N>(input)` equals `Fingerprint128(input, N)`, but is inlined
+// into the caller with every length test decided and the `CityMurmur()` loop
+// unrolled, leaving straight-line code for keys under 144 bytes (longer keys
+// are dominated by the main loop and just call the generic function).
+//
+//     UInt128 a = FarmHash::Fingerprint128<16>(uuid.bytes);
+//     UInt128 b = FarmHash::Fingerprint128(user_id);          // uint64_t
+//     UInt128 c = FarmHash::Fingerprint128(composite_key);    // a plain struct
+//
+// An integer of any width and signedness is hashed as its little-endian bytes,
+// so the result is the same on every platform.  Other trivially-copyable values
+// are hashed as the bytes they occupy in memory; where the compiler can tell (C++17), types with padding
+// or floating-point members are rejected, as equal values of them need not have
+// equal bytes.
+//
+#ifndef FARM_HASH_FIXED_HPP
+#define FARM_HASH_FIXED_HPP
+
+#include "FarmHash.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <type_traits>
+#include <utility>
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define FARM_HASH_FIXED_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#   define FARM_HASH_FIXED_INLINE __forceinline
+#else
+#   define FARM_HASH_FIXED_INLINE inline
+#endif
+
+namespace FarmHash {
+
+    namespace detail {
+
+        // HashLen0to16() of 'Len' bytes.
+
+        template <size_t Len, int Kind = (Len >= 8 ? 2 : Len >= 4 ? 1 : Len > 0 ? 0 : -1)>
+        struct HashLen0to16Fixed {
+            static FARM_HASH_FIXED_INLINE uint64_t Hash(const uint8_t *s) {
+                uint64_t mul = k2 + Len * 2;
+                uint64_t a = Fetch64(s) + k2;
+                uint64_t b = Fetch64(s + Len - 8);
+                uint64_t c = RotateRight64(b, 37) * mul + a;
+                uint64_t d = (RotateRight64(a, 25) + b) * mul;
+                return HashLen16(c, d, mul);
+            }
+        };
+
+        template <size_t Len>
+        struct HashLen0to16Fixed<Len, 1> {
+            static FARM_HASH_FIXED_INLINE uint64_t Hash(const uint8_t *s) {
+                uint64_t mul = k2 + Len * 2;
+                uint64_t a = Fetch32(s);
+                return HashLen16(Len + (a << 3), Fetch32(s + Len - 4), mul);
+            }
+        };
+
+        template <size_t Len>
+        struct HashLen0to16Fixed<Len, 0> {
+            static FARM_HASH_FIXED_INLINE uint64_t Hash(const uint8_t *s) {
+                uint32_t y = static_cast<uint32_t>(s[0]) + (static_cast<uint32_t>(s[Len >> 1]) << 8);
+                uint32_t z = Len + (static_cast<uint32_t>(s[Len - 1]) << 2);
+                return ShiftMix(y * k2 ^ z * k0) * k2;
+            }
+        };
+
+        template <size_t Len>
+        struct HashLen0to16Fixed<Len, -1> {
+            static FARM_HASH_FIXED_INLINE uint64_t Hash(const uint8_t *) {
+                return k2;
+            }
+        };
+
+        // The 'do ... while' loop of CityMurmur(), unrolled.
+
+        template <size_t Blocks>
+        struct CityMurmurBlocks {
+            static FARM_HASH_FIXED_INLINE void Run(const uint8_t *s, uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d) {
+                a ^= ShiftMix(Fetch64(s) * k1) * k1;
+                a *= k1;
+                b ^= a;
+                c ^= ShiftMix(Fetch64(s + 8) * k1) * k1;
+                c *= k1;
+                d ^= c;
+                CityMurmurBlocks<Blocks - 1>::Run(s + 16, a, b, c, d);
+            }
+        };
+
+        template <>
+        struct CityMurmurBlocks<0> {
+            static FARM_HASH_FIXED_INLINE void Run(const uint8_t *, uint64_t &, uint64_t &, uint64_t &, uint64_t &) {}
+        };
+
+        FARM_HASH_FIXED_INLINE UInt128 CityMurmurFinish(uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+            a = HashLen16(a, c);
+            b = HashLen16(d, b);
+            return UInt128(a ^ b, HashLen16(b, a));
+        }
+
+        // CityMurmur() of 'Len' bytes.
+
+        template <size_t Len, bool Long = (Len > 16)>
+        struct CityMurmurFixed {
+            static FARM_HASH_FIXED_INLINE UInt128 Hash(const uint8_t *s, UInt128 seed) {
+                uint64_t a = ShiftMix(UInt128Low64(seed) * k1) * k1;
+                uint64_t b = UInt128High64(seed);
+                uint64_t c = b * k1 + HashLen0to16Fixed<Len>::Hash(s);
+                uint64_t d = ShiftMix(a + (Len >= 8 ? Fetch64(s) : c));
+                return CityMurmurFinish(a, b, c, d);
+            }
+        };
+
+        template <size_t Len>
+        struct CityMurmurFixed<Len, true> {
+            static FARM_HASH_FIXED_INLINE UInt128 Hash(const uint8_t *s, UInt128 seed) {
+                uint64_t a = UInt128Low64(seed);
+                uint64_t b = UInt128High64(seed);
+                uint64_t c = HashLen16(Fetch64(s + Len - 8) + k1, a);
+                uint64_t d = HashLen16(b + Len, c + Fetch64(s + Len - 16));
+                a += d;
+                CityMurmurBlocks<(Len - 1) / 16>::Run(s, a, b, c, d);
+                return CityMurmurFinish(a, b, c, d);
+            }
+        };
+
+        // CityHash128() of 'N' bytes: unseeded, seeded from the first 16 bytes, or
+        // long enough for the main loop.
+
+        template <size_t N, int Kind = (N < 16 ? 0 : N < 16 + 128 ? 1 : 2)>
+        struct Fingerprint128Fixed {
+            static FARM_HASH_FIXED_INLINE UInt128 Hash(const uint8_t *s) {
+                return CityMurmurFixed<N>::Hash(s, UInt128(k0, k1));
+            }
+        };
+
+        template <size_t N>
+        struct Fingerprint128Fixed<N, 1> {
+            static FARM_HASH_FIXED_INLINE UInt128 Hash(const uint8_t *s) {
+                return CityMurmurFixed<N - 16>::Hash(s + 16, UInt128(Fetch64(s), Fetch64(s + 8) + k0));
+            }
+        };
+
+        template <size_t N>
+        struct Fingerprint128Fixed<N, 2> {
+            static inline UInt128 Hash(const uint8_t *s) {
+                return Fingerprint128(s, N);
+            }
+        };
+
+        template <typename T, typename = void>
+        struct HasData : std::false_type {};
+
+        template <typename T>
+        struct HasData<T, decltype(void(std::declval<const T &>().data()))> : std::true_type {};
+
+        // Integers hashed as their little-endian bytes.  A 'bool' has only one.
+
+        template <typename T>
+        struct IsFingerprintableInteger {
+            static const bool value = std::is_integral<T>::value && !std::is_same<T, bool>::value;
+        };
+
+        // Other values hashed as their bytes.  Pointers, arrays and strings (even
+        // trivially-copyable ones, such as 'std::string_view') are not.
+
+        template <typename T>
+        struct IsFingerprintableValue {
+            static const bool value = std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value && !std::is_array<T>::value && !HasData<T>::value && !IsFingerprintableInteger<T>::value
+            #if defined(__cpp_lib_has_unique_object_representations)
+                && std::has_unique_object_representations<T>::value
+            #endif
+                ;
+        };
+
+    }
+
+    template <size_t N>
+    FARM_HASH_FIXED_INLINE UInt128 Fingerprint128(const uint8_t *input) {
+        return detail::Fingerprint128Fixed<N>::Hash(input);
+    }
+
+    template <size_t N>
+    FARM_HASH_FIXED_INLINE UInt128 Fingerprint128(const int8_t *input) {
+        return detail::Fingerprint128Fixed<N>::Hash((const uint8_t *)input);
+    }
+
+    template <typename T, typename std::enable_if<detail::IsFingerprintableInteger<T>::value, int>::type = 0>
+    FARM_HASH_FIXED_INLINE UInt128 Fingerprint128(T value) {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        Unsigned bits = static_cast<Unsigned>(value);
+        uint8_t bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); i++) {
+            bytes[i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+        return Fingerprint128<sizeof(T)>(bytes);
+    }
+
+    template <typename T, typename = typename std::enable_if<detail::IsFingerprintableValue<T>::value>::type>
+    FARM_HASH_FIXED_INLINE UInt128 Fingerprint128(const T &value) {
+        return Fingerprint128<sizeof(T)>(reinterpret_cast<const uint8_t *>(&value));
+    }
+
+}
+
+#undef FARM_HASH_FIXED_INLINE
+
+#endif // ! FARM_HASH_FIXED_HPP
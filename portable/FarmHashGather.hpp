@@ -0,0 +1,220 @@
+// `Fingerprint128` of data in several segments, as from `readv()`, without joining them.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// The result is `Fingerprint128()` of the concatenation of the segments, but
+// the 128-byte main-loop blocks are hashed where they lie; only a block that
+// straddles two segments is copied, into a buffer on the stack, as are the
+// seed and the tail when they straddle (at most 255 bytes), and inputs too
+// short for the main loop (under 144 bytes) that span more than one segment.
+// Empty segments are allowed anywhere.
+//
+//     struct iovec iov[3];
+//     ssize_t n = readv(fd, iov, 3);
+//     UInt128 fingerprint = FarmHash::Fingerprint128(iov, 3);
+//
+// With C++20, a `std::span` of `std::span<const uint8_t>` segments (a rope, or
+// a `std::vector` of spans) is accepted as well.
+//
+// POSIX only, for `struct iovec`.
+//
+#ifndef FARM_HASH_GATHER_HPP
+#define FARM_HASH_GATHER_HPP
+
+#include "FarmHash.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <sys/uio.h>
+
+#if FARM_HASH_CPLUSPLUS >= 202002L && defined(__has_include)
+#   if __has_include(<span>)
+#       include <span>
+#   endif
+#endif
+
+namespace FarmHash {
+
+    namespace detail {
+
+        inline const uint8_t *SegmentData(const struct iovec &segment) { return static_cast<const uint8_t *>(segment.iov_base); }
+        inline size_t SegmentLength(const struct iovec &segment) { return segment.iov_len; }
+
+    #if defined(__cpp_lib_span)
+        inline const uint8_t *SegmentData(const std::span<const uint8_t> &segment) { return segment.data(); }
+        inline size_t SegmentLength(const std::span<const uint8_t> &segment) { return segment.size(); }
+    #endif
+
+        // Reads a sequence of segments front to back, skipping empty ones.
+
+        template <typename Segment>
+        class GatherCursor {
+
+        public:
+
+            GatherCursor(const Segment *segments, size_t n) : segment_(segments), end_(segments + n), offset_(0) {
+                Skip();
+            }
+
+            // The next `n > 0` bytes, which must be there: in place if they lie in
+            // one segment, or else copied to `scratch`.
+
+            const uint8_t *Next(size_t n, uint8_t *scratch) {
+                size_t available = SegmentLength(*segment_) - offset_;
+                if (IsLikely(n < available)) {
+                    const uint8_t *p = SegmentData(*segment_) + offset_;
+                    offset_ += n;
+                    return p;
+                }
+                if (n == available) {
+                    const uint8_t *p = SegmentData(*segment_) + offset_;
+                    ++segment_;
+                    offset_ = 0;
+                    Skip();
+                    return p;
+                }
+                for (size_t done = 0; done < n; ) {
+                    size_t m = std::min(n - done, SegmentLength(*segment_) - offset_);
+                    std::memcpy(scratch + done, SegmentData(*segment_) + offset_, m);
+                    done += m;
+                    offset_ += m;
+                    if (offset_ == SegmentLength(*segment_)) {
+                        ++segment_;
+                        offset_ = 0;
+                        Skip();
+                    }
+                }
+                return scratch;
+            }
+
+            // As many of the next `count` runs of `size` bytes as lie in the
+            // current segment, in place; `count` becomes how many that is.
+
+            const uint8_t *Runs(size_t size, size_t &count) {
+                const uint8_t *p = SegmentData(*segment_) + offset_;
+                count = std::min(count, (SegmentLength(*segment_) - offset_) / size);
+                offset_ += count * size;
+                if (offset_ == SegmentLength(*segment_)) {
+                    ++segment_;
+                    offset_ = 0;
+                    Skip();
+                }
+                return p;
+            }
+
+        private:
+
+            void Skip() {
+                while (segment_ != end_ && SegmentLength(*segment_) == 0) {
+                    ++segment_;
+                }
+            }
+
+            const Segment *segment_, *end_;
+            size_t offset_;
+
+        };
+
+        // CityHash128Impl() of the concatenation of the segments.
+
+        template <typename Segment>
+        UInt128 Fingerprint128Gather(const Segment *segments, size_t n) {
+            size_t len = 0, nonempty = 0;
+            const Segment *only = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (SegmentLength(segments[i]) > 0) {
+                    len += SegmentLength(segments[i]);
+                    nonempty++;
+                    only = segments + i;
+                }
+            }
+            if (nonempty <= 1) {
+                static const uint8_t empty[1] = { 0 };
+                return CityHash128Impl(only ? SegmentData(*only) : empty, len);
+            }
+
+            GatherCursor<Segment> cursor(segments, n);
+            if (len < 16 + 128) {
+                uint8_t whole[16 + 128];
+                return CityHash128Impl(cursor.Next(len, whole), len);
+            }
+
+            uint8_t scratch[256];     // a block copied from two segments, then a tail
+            const uint8_t *s = cursor.Next(16, scratch);
+            UInt128 seed(Fetch64(s), Fetch64(s + 8) + k0);
+            len -= 16;
+
+            CityHash128State st = {};
+            s = cursor.Next(128, scratch);
+            CityHash128Begin(st, s, len, seed);
+            CityHash128Block(st, s);
+            for (size_t blocks = len / 128 - 1; blocks > 0; ) {
+                size_t n = blocks;
+                const uint8_t *p = cursor.Runs(128, n);
+                if (n == 0) {
+                    s = cursor.Next(128, scratch);
+                    CityHash128Block(st, s);
+                    blocks--;
+                    continue;
+                }
+                for (size_t i = 0; i < n; i++) {
+                    CityHash128Block(st, p + 128 * i);
+                }
+                s = p + 128 * (n - 1);
+                blocks -= n;
+            }
+
+            // The tail is read backwards, reaching into the last block, so the
+            // two must be contiguous.
+
+            len %= 128;
+            if (len == 0) {
+                return CityHash128End(st, s + 128, 0);
+            }
+            const uint8_t *t = cursor.Next(len, scratch + 128);
+            if (t != s + 128) {
+                if (s != scratch) {
+                    std::memcpy(scratch, s, 128);
+                }
+                if (t != scratch + 128) {
+                    std::memcpy(scratch + 128, t, len);
+                }
+                t = scratch + 128;
+            }
+            return CityHash128End(st, t, len);
+        }
+
+    }
+
+    inline UInt128 Fingerprint128(const struct iovec *iov, int iovcnt) {
+        return detail::Fingerprint128Gather(iov, iovcnt > 0 ? static_cast<size_t>(iovcnt) : 0);
+    }
+
+#if defined(__cpp_lib_span)
+    inline UInt128 Fingerprint128(std::span<const std::span<const uint8_t> > segments) {
+        return detail::Fingerprint128Gather(segments.data(), segments.size());
+    }
+#endif
+
+}
+
+#endif // ! FARM_HASH_GATHER_HPP
@@ -0,0 +1,170 @@
+// An incrementally updated Merkle fingerprint of a large mutable buffer.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FarmHashMerkle.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    namespace {
+
+        void Store(const UInt128 &h, uint8_t *out) {
+            uint64_t lo = uint64_in_little_endian_order(UInt128Low64(h));
+            uint64_t hi = uint64_in_little_endian_order(UInt128High64(h));
+            std::memcpy(out, &lo, 8);
+            std::memcpy(out + 8, &hi, 8);
+        }
+
+        // Node 'i' of 'level', from the level below it.
+
+        UInt128 Parent(const std::vector<UInt128> &below, size_t i, size_t level) {
+            if (2 * i + 1 == below.size()) {
+                return below[2 * i];
+            }
+            uint8_t children[32];
+            Store(below[2 * i], children);
+            Store(below[2 * i + 1], children + 16);
+            return CityHash128WithSeed(children, sizeof(children), UInt128(level, kMerkleFingerprintVersion));
+        }
+
+    }
+
+    MerkleFingerprint::MerkleFingerprint(size_t block_size) : block_size_(block_size), data_(0), length_(0) {
+        assert(block_size > 0);
+        Reset(0, 0);
+    }
+
+    void MerkleFingerprint::Reset(const uint8_t *data, size_t length) {
+        Reset(data, length, static_cast<ThreadPool *>(0));
+    }
+
+    void MerkleFingerprint::Reset(const uint8_t *data, size_t length, ThreadPool &pool) {
+        Reset(data, length, &pool);
+    }
+
+    void MerkleFingerprint::Reset(const uint8_t *data, size_t length, ThreadPool *pool) {
+        data_ = data;
+        length_ = length;
+        size_t blocks = length == 0 ? 1 : 1 + (length - 1) / block_size_;
+        levels_.assign(1, std::vector<UInt128>(blocks));
+        marked_.assign((blocks + 63) / 64, 0);
+        dirty_.resize(blocks);
+        for (size_t i = 0; i < blocks; i++) {
+            dirty_[i] = i;
+        }
+        HashBlocks(dirty_.data(), blocks, pool);
+        std::vector<size_t>().swap(dirty_);
+        for (size_t level = 1; levels_.back().size() > 1; level++) {
+            std::vector<UInt128> nodes((levels_.back().size() + 1) / 2);
+            for (size_t i = 0; i < nodes.size(); i++) {
+                nodes[i] = Parent(levels_.back(), i, level);
+            }
+            levels_.push_back(std::vector<UInt128>());
+            levels_.back().swap(nodes);
+        }
+    }
+
+    void MerkleFingerprint::HashBlocks(const size_t *blocks, size_t n, ThreadPool *pool) {
+        static const uint8_t empty[1] = { 0 };
+        std::vector<UInt128> &leaves = levels_[0];
+        auto body = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                size_t offset = blocks[i] * block_size_;
+                leaves[blocks[i]] = Fingerprint128(length_ ? data_ + offset : empty, std::min(block_size_, length_ - offset));
+            }
+        };
+        if (!pool || n < 2) {
+            body(0, n);
+            return;
+        }
+
+        // As in Fingerprint128Tree(), a handful of small blocks per task.
+
+        pool->ParallelFor(0, n, std::max<size_t>(1, (256 * 1024) / block_size_), body);
+    }
+
+    void MerkleFingerprint::MarkDirty(size_t offset, size_t length) {
+        if (offset >= length_) {
+            return;
+        }
+        length = std::min(length, length_ - offset);
+        if (length == 0) {
+            return;
+        }
+        for (size_t b = offset / block_size_, last = (offset + length - 1) / block_size_; b <= last; b++) {
+            if (!(marked_[b / 64] >> (b % 64) & 1)) {
+                marked_[b / 64] |= uint64_t(1) << (b % 64);
+                dirty_.push_back(b);
+            }
+        }
+    }
+
+    UInt128 MerkleFingerprint::Root() {
+        return Root(static_cast<ThreadPool *>(0));
+    }
+
+    UInt128 MerkleFingerprint::Root(ThreadPool &pool) {
+        return Root(&pool);
+    }
+
+    // Rehash the dirty blocks, then each level's parents of the nodes changed
+    // in the level below.
+
+    UInt128 MerkleFingerprint::Root(ThreadPool *pool) {
+        if (!dirty_.empty()) {
+            std::sort(dirty_.begin(), dirty_.end());
+            HashBlocks(dirty_.data(), dirty_.size(), pool);
+            for (size_t i = 0; i < dirty_.size(); i++) {
+                marked_[dirty_[i] / 64] = 0;
+            }
+            std::vector<size_t> &changed = dirty_;
+            for (size_t level = 1; level < levels_.size(); level++) {
+                size_t parents = 0;
+                for (size_t i = 0; i < changed.size(); i++) {
+                    if (parents == 0 || changed[parents - 1] != changed[i] / 2) {
+                        changed[parents++] = changed[i] / 2;
+                    }
+                }
+                changed.resize(parents);
+                for (size_t i = 0; i < parents; i++) {
+                    levels_[level][changed[i]] = Parent(levels_[level - 1], changed[i], level);
+                }
+            }
+            dirty_.clear();
+        }
+
+        uint8_t root[16];
+        Store(levels_.back()[0], root);
+        UInt128 seed(Hash128to64(UInt128(length_, block_size_)), Hash128to64(UInt128(kMerkleFingerprintVersion, Blocks())));
+        return CityHash128WithSeed(root, sizeof(root), seed);
+    }
+
+}
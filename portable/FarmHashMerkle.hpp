@@ -0,0 +1,107 @@
+// An incrementally updated Merkle fingerprint of a large mutable buffer.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// THIS IS NOT `Fingerprint128`.  The buffer is cut into `block_size` blocks
+// (the last one possibly shorter), each block is fingerprinted on its own, and
+// pairs of fingerprints are combined level by level into a binary tree, an odd
+// node out at the end of a level being carried up as it is.  A node is
+// `CityHash128WithSeed()` of its two children's little-endian bytes, seeded
+// with its level and the format version; the root is further hashed with a
+// seed made from the length, block size and block count.
+//
+// After the caller changes part of the buffer in place and reports it with
+// `MarkDirty()`, `Root()` rehashes only the dirty blocks and the nodes on
+// their paths to the root, so an update costs in proportion to the change
+// (plus a `log2(blocks)` path per dirty block), not to the buffer.
+//
+//     FarmHash::MerkleFingerprint merkle;
+//     merkle.Reset(image, size, pool);
+//     image[offset] = ...;
+//     merkle.MarkDirty(offset, 1);
+//     UInt128 fingerprint = merkle.Root(pool);
+//
+// The result depends on the contents, `block_size` and
+// `kMerkleFingerprintVersion` only, never on the order of edits or on the
+// number of threads.  Any change to the construction above must bump the
+// version.  The buffer is not owned; a `MerkleFingerprint` must not be used by
+// two threads at once.
+//
+#ifndef FARM_HASH_MERKLE_HPP
+#define FARM_HASH_MERKLE_HPP
+
+#include "FarmHash.hpp"
+#include "ThreadPool.hpp"
+
+#include <vector>
+
+namespace FarmHash {
+
+    const uint32_t kMerkleFingerprintVersion = 1;
+
+    const size_t kMerkleFingerprintBlock = 64 * 1024;
+
+    class MerkleFingerprint {
+
+    public:
+
+        explicit MerkleFingerprint(size_t block_size = kMerkleFingerprintBlock);
+
+        // Fingerprint every block of `data` from scratch.  Needed whenever the
+        // buffer moves or changes length.
+
+        void Reset(const uint8_t *data, size_t length);
+        void Reset(const uint8_t *data, size_t length, ThreadPool &pool);
+
+        // Note that `data[offset, offset + length)` has changed.  The range is
+        // clipped to the buffer: any part of it past the end is ignored.
+
+        void MarkDirty(size_t offset, size_t length);
+
+        // The fingerprint of the buffer as it is now.  Dirty blocks are
+        // rehashed on `pool`, if given, when there are several of them.
+
+        UInt128 Root();
+        UInt128 Root(ThreadPool &pool);
+
+        size_t Blocks() const { return levels_.empty() ? 0 : levels_[0].size(); }
+        size_t DirtyBlocks() const { return dirty_.size(); }
+
+    private:
+
+        void Reset(const uint8_t *data, size_t length, ThreadPool *pool);
+        void HashBlocks(const size_t *blocks, size_t n, ThreadPool *pool);
+        UInt128 Root(ThreadPool *pool);
+
+        size_t block_size_;
+        const uint8_t *data_;
+        size_t length_;
+        std::vector<std::vector<UInt128> > levels_;     // the blocks' fingerprints, then each level up
+        std::vector<uint64_t> marked_;                  // one bit per block
+        std::vector<size_t> dirty_;                     // the marked blocks, in marking order
+
+    };
+
+}
+
+#endif // ! FARM_HASH_MERKLE_HPP
@@ -0,0 +1,258 @@
+// Optional counters of which paths of `Fingerprint128()` are taken, and how fast.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FarmHashStats.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#   include <x86intrin.h>
+#   define FARM_HASH_STATS_RDTSC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#   include <intrin.h>
+#   define FARM_HASH_STATS_RDTSC
+#endif
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    namespace {
+
+        const size_t kLengthBuckets = HashStats::kLengthBuckets;
+        const size_t kTimeBuckets = HashStats::kTimeBuckets;
+
+        // One thread's counts, with the same fields as 'HashStats'.  Only the
+        // owning thread stores to them.
+
+        struct Counters {
+            std::atomic<uint64_t> calls;
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> hash_len_0_to_16;
+            std::atomic<uint64_t> city_murmur;
+            std::atomic<uint64_t> main_loop;
+            std::atomic<uint64_t> blocks;
+            std::atomic<uint64_t> tail_chunks[5];
+            std::atomic<uint64_t> lengths[kLengthBuckets];
+            std::atomic<uint64_t> samples[kLengthBuckets];
+            std::atomic<uint64_t> sampled_time[kLengthBuckets];
+            std::atomic<uint64_t> times[kLengthBuckets][kTimeBuckets];
+        };
+
+        // Calls 'f(a.field, b.field)' for every field.
+
+        template <typename A, typename B, typename F>
+        void ForEachField(A &a, B &b, F f) {
+            f(a.calls, b.calls);
+            f(a.bytes, b.bytes);
+            f(a.hash_len_0_to_16, b.hash_len_0_to_16);
+            f(a.city_murmur, b.city_murmur);
+            f(a.main_loop, b.main_loop);
+            f(a.blocks, b.blocks);
+            for (size_t i = 0; i < 5; i++) {
+                f(a.tail_chunks[i], b.tail_chunks[i]);
+            }
+            for (size_t i = 0; i < kLengthBuckets; i++) {
+                f(a.lengths[i], b.lengths[i]);
+                f(a.samples[i], b.samples[i]);
+                f(a.sampled_time[i], b.sampled_time[i]);
+                for (size_t t = 0; t < kTimeBuckets; t++) {
+                    f(a.times[i][t], b.times[i][t]);
+                }
+            }
+        }
+
+        void Add(HashStats &total, const Counters &counters) {
+            ForEachField(total, counters, [](uint64_t &t, const std::atomic<uint64_t> &c) {
+                t += c.load(std::memory_order_relaxed);
+            });
+        }
+
+        inline void Bump(std::atomic<uint64_t> &counter, uint64_t by = 1) {
+            counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+
+        // 0 for 0, else 'b' for '[2^(b-1), 2^b)', up to 'buckets - 1'.
+
+        inline size_t Bucket(uint64_t x, size_t buckets) {
+            size_t b = 0;
+        #if defined(__GNUC__) || defined(__clang__)
+            b = x ? 64 - __builtin_clzll(x) : 0;
+        #else
+            for (; x; x >>= 1) {
+                b++;
+            }
+        #endif
+            return b < buckets ? b : buckets - 1;
+        }
+
+        inline uint64_t Now() {
+        #if defined(FARM_HASH_STATS_RDTSC)
+            return __rdtsc();
+        #else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+        }
+
+        // The live threads' counters, and what exited threads left.  Never
+        // destroyed, as threads may still be exiting when statics are.
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<Counters *> live;
+            HashStats retired;
+        };
+
+        Registry &TheRegistry() {
+            static Registry *registry = new Registry;
+            return *registry;
+        }
+
+        struct ThreadCounters {
+
+            Counters *counters;
+            unsigned until_sample;
+
+            ThreadCounters() : counters(new Counters()), until_sample(kHashStatsSampleEvery) {
+                Registry &registry = TheRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.live.push_back(counters);
+            }
+
+            ~ThreadCounters() {
+                Registry &registry = TheRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                Add(registry.retired, *counters);
+                for (size_t i = 0; i < registry.live.size(); i++) {
+                    if (registry.live[i] == counters) {
+                        registry.live[i] = registry.live.back();
+                        registry.live.pop_back();
+                        break;
+                    }
+                }
+                delete counters;
+            }
+
+        };
+
+        ThreadCounters &ThisThread() {
+            thread_local ThreadCounters counters;
+            return counters;
+        }
+
+    }
+
+    HashStats::HashStats() {
+        ForEachField(*this, *this, [](uint64_t &a, uint64_t &) { a = 0; });
+    }
+
+    HashStats &HashStats::operator-=(const HashStats &earlier) {
+        ForEachField(*this, earlier, [](uint64_t &a, const uint64_t &b) { a -= b; });
+        return *this;
+    }
+
+    HashStats GetHashStats() {
+        Registry &registry = TheRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        HashStats total = registry.retired;
+        for (size_t i = 0; i < registry.live.size(); i++) {
+            Add(total, *registry.live[i]);
+        }
+        return total;
+    }
+
+    std::string HashStatsToJson(const HashStats &stats) {
+        std::string json = "{\"calls\": " + std::to_string(stats.calls) + ", \"bytes\": " + std::to_string(stats.bytes);
+        json += ", \"hash_len_0_to_16\": " + std::to_string(stats.hash_len_0_to_16);
+        json += ", \"city_murmur\": " + std::to_string(stats.city_murmur);
+        json += ", \"main_loop\": " + std::to_string(stats.main_loop);
+        json += ", \"blocks\": " + std::to_string(stats.blocks);
+        json += ", \"tail_chunks\": [";
+        for (size_t i = 0; i < 5; i++) {
+            json += (i ? ", " : "") + std::to_string(stats.tail_chunks[i]);
+        }
+        json += "], \"lengths\": [";
+        const char *separator = "";
+        for (size_t b = 0; b < kLengthBuckets; b++) {
+            if (!stats.lengths[b]) {
+                continue;
+            }
+            uint64_t min = b ? uint64_t(1) << (b - 1) : 0;
+            json += separator;
+            json += "{\"min\": " + std::to_string(min);
+            if (b + 1 < kLengthBuckets) {
+                json += ", \"max\": " + std::to_string(b ? 2 * min - 1 : 0);
+            }
+            json += ", \"calls\": " + std::to_string(stats.lengths[b]);
+            json += ", \"samples\": " + std::to_string(stats.samples[b]);
+            json += ", \"sampled_time\": " + std::to_string(stats.sampled_time[b]);
+            json += ", \"times\": [";
+            for (size_t t = 0; t < kTimeBuckets; t++) {
+                json += (t ? ", " : "") + std::to_string(stats.times[b][t]);
+            }
+            json += "]}";
+            separator = ", ";
+        }
+        return json + "]}";
+    }
+
+    namespace detail {
+
+        HashStatsScope::HashStatsScope(size_t length, size_t l) : length_(length), l_(l), start_(0) {
+            ThreadCounters &thread = ThisThread();
+            if (--thread.until_sample == 0) {
+                thread.until_sample = kHashStatsSampleEvery;
+                start_ = Now();
+            }
+        }
+
+        HashStatsScope::~HashStatsScope() {
+            uint64_t time = start_ ? Now() - start_ : 0;
+            Counters &c = *ThisThread().counters;
+            size_t bucket = Bucket(length_, kLengthBuckets);
+            Bump(c.calls);
+            Bump(c.bytes, length_);
+            Bump(c.lengths[bucket]);
+            if (l_ <= 16) {
+                Bump(c.hash_len_0_to_16);
+            } else if (l_ < 128) {
+                Bump(c.city_murmur);
+            } else {
+                Bump(c.main_loop);
+                Bump(c.blocks, l_ / 128);
+                Bump(c.tail_chunks[(l_ % 128 + 31) / 32]);
+            }
+            if (start_) {
+                Bump(c.samples[bucket]);
+                Bump(c.sampled_time[bucket], time);
+                Bump(c.times[bucket][Bucket(time, kTimeBuckets)]);
+            }
+        }
+
+    }
+
+}
@@ -0,0 +1,134 @@
+// Optional counters of which paths of `Fingerprint128()` are taken, and how fast.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Compiled in only when `FARM_HASH_STATS` is defined to 1 when building
+// `FarmHash.cpp`; otherwise `Fingerprint128()` is untouched and the snapshot is
+// all zeros.  Every call to `Fingerprint128()`, `CityHash128()` or
+// `CityHash128WithSeed()` is counted (including those made by
+// `Fingerprint128Column()` and `Fingerprint128Tree()`), but not the batch,
+// multi-seed, streaming, gathered, fixed-length or constexpr forms.
+//
+// What CityHash128 runs on is `l`, the length less the 16 bytes it takes as the
+// seed (if it has that many and was not given a seed):
+//
+//   - `hash_len_0_to_16`, for `l <= 16`: `CityMurmur()`, whose work is one
+//     `HashLen0to16()`;
+//   - `city_murmur`, for `16 < l < 128`: `CityMurmur()`'s 16-byte loop;
+//   - `main_loop`, for `l >= 128`: `blocks` iterations of the 128-byte loop,
+//     then 0 to 4 tail chunks of 32 bytes (`tail_chunks[n]` counts the calls
+//     that ended with `n`).
+//
+// Lengths (before taking off the seed) are counted in power-of-two buckets:
+// bucket 0 is length 0, and bucket `b > 0` holds `[2^(b-1), 2^b)`, the last
+// bucket taking everything longer.  One call in `kHashStatsSampleEvery` per
+// thread is also timed, in TSC ticks on x86 and nanoseconds elsewhere, into
+// a power-of-two histogram for its length bucket; the timer's own overhead
+// (a few tens of ticks) is included.
+//
+// Each thread counts into its own block, with relaxed atomic stores that only
+// it makes, so counting takes no locks and no read-modify-write instructions.
+// `GetHashStats()` adds up the blocks of the live threads and the totals left by
+// threads that have exited; it does not stop anyone, so a snapshot taken while
+// hashing is under way may be a few calls out of step between counters.
+// Subtract two snapshots to measure an interval.
+//
+#ifndef FARM_HASH_STATS_HPP
+#define FARM_HASH_STATS_HPP
+
+#include "UInt128.hpp"
+
+#include <string>
+
+#if !defined(FARM_HASH_STATS)
+#   define FARM_HASH_STATS 0
+#endif
+
+namespace FarmHash {
+
+    const bool kHashStatsEnabled = FARM_HASH_STATS != 0;
+
+    const unsigned kHashStatsSampleEvery = 1024;
+
+    struct HashStats {
+
+        static const size_t kLengthBuckets = 41;
+        static const size_t kTimeBuckets = 32;
+
+        uint64_t calls;
+        uint64_t bytes;
+
+        uint64_t hash_len_0_to_16;
+        uint64_t city_murmur;
+        uint64_t main_loop;
+        uint64_t blocks;
+        uint64_t tail_chunks[5];
+
+        uint64_t lengths[kLengthBuckets];
+
+        // Of the timed calls in each length bucket: how many, their total time,
+        // and how many took '[2^(t-1), 2^t)' ticks, in bucket 't'.
+
+        uint64_t samples[kLengthBuckets];
+        uint64_t sampled_time[kLengthBuckets];
+        uint64_t times[kLengthBuckets][kTimeBuckets];
+
+        HashStats();
+
+        HashStats &operator-=(const HashStats &earlier);
+
+    };
+
+    HashStats GetHashStats();
+
+    // One JSON object, with only the length buckets that saw a call.
+
+    std::string HashStatsToJson(const HashStats &stats);
+
+    namespace detail {
+
+        // Around each counted call, in `FarmHash.cpp`.  `l` is the length after
+        // the seed is taken off.
+
+        class HashStatsScope {
+
+        public:
+
+            HashStatsScope(size_t length, size_t l);
+            ~HashStatsScope();
+
+            HashStatsScope(const HashStatsScope &) = delete;
+            HashStatsScope &operator=(const HashStatsScope &) = delete;
+
+        private:
+
+            size_t length_, l_;
+            uint64_t start_;        // zero unless this call is timed
+
+        };
+
+    }
+
+}
+
+#endif // ! FARM_HASH_STATS_HPP
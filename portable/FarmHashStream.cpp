@@ -0,0 +1,155 @@
+// Incremental computation of `FarmHash::Fingerprint128`.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FarmHashStream.hpp"
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    Fingerprint128Stream::Fingerprint128Stream()
+        : sized_(false), streaming_(false), seeded_(false), overrun_(false), length_(0), consumed_(0), blocks_(0), pending_(0), seed_(0, 0)
+    {
+    }
+
+    // Inputs of 144 bytes or more are 16 bytes of seed followed by at least one
+    // 128-byte main-loop block; anything shorter goes to CityMurmur() and is
+    // simply buffered, as it fits in 'buffer_'.
+
+    Fingerprint128Stream::Fingerprint128Stream(uint64_t length)
+        : sized_(true), streaming_(length >= 16 + 128), seeded_(false), overrun_(false), length_(length), consumed_(0), blocks_(length >= 16 + 128 ? (length - 16) / 128 : 0), pending_(0), seed_(0, 0)
+    {
+    }
+
+    void Fingerprint128Stream::Block(const uint8_t *block) {
+        if (IsUnlikely(!seeded_)) {
+            CityHash128Begin(state_, block, length_ - 16, seed_);
+            seeded_ = true;
+        }
+        CityHash128Block(state_, block);
+        blocks_--;
+    }
+
+    void Fingerprint128Stream::Update(const uint8_t *input, size_t length) {
+
+        if (sized_ && length > length_ - consumed_) {
+            overrun_ = true;
+            length = length_ - consumed_;
+        }
+
+        if (length == 0) {
+            return;
+        }
+
+        uint64_t seed_remaining = consumed_ < 16 ? 16 - consumed_ : 0;
+        consumed_ += length;
+
+        if (!sized_) {
+            unsized_.insert(unsized_.end(), input, input + length);
+            return;
+        }
+
+        if (!streaming_) {
+            std::memcpy(buffer_ + pending_, input, length);
+            pending_ += length;
+            return;
+        }
+
+        // The first 16 bytes are the seed for CityHash128WithSeed().
+
+        if (seed_remaining > 0) {
+            size_t n = std::min<uint64_t>(seed_remaining, length);
+            std::memcpy(buffer_ + 128 + pending_, input, n);
+            pending_ += n;
+            input += n;
+            length -= n;
+            if (pending_ < 16) {
+                return;
+            }
+            seed_ = UInt128(Fetch64(buffer_ + 128), Fetch64(buffer_ + 136) + k0);
+            pending_ = 0;
+        }
+
+        while (length > 0) {
+
+            // Past the last main-loop block, everything is tail.
+
+            if (blocks_ == 0) {
+                std::memcpy(buffer_ + 128 + pending_, input, length);
+                pending_ += length;
+                return;
+            }
+
+            // Hash whole blocks straight from the caller's memory when we can,
+            // keeping a copy of the last one for the tail.
+
+            if (pending_ == 0 && length >= 128) {
+                size_t n = std::min<uint64_t>(blocks_, length / 128);
+                for (size_t i = 0; i < n; i++) {
+                    Block(input);
+                    input += 128;
+                }
+                length -= n * 128;
+                std::memcpy(buffer_, input - 128, 128);
+                continue;
+            }
+
+            size_t n = std::min<size_t>(128 - pending_, length);
+            std::memcpy(buffer_ + 128 + pending_, input, n);
+            pending_ += n;
+            input += n;
+            length -= n;
+            if (pending_ == 128) {
+                Block(buffer_ + 128);
+                std::memcpy(buffer_, buffer_ + 128, 128);
+                pending_ = 0;
+            }
+
+        }
+
+    }
+
+    UInt128 Fingerprint128Stream::Final() const {
+
+        if (!Complete()) {
+            return UInt128(0, 0);
+        }
+
+        if (!sized_) {
+            return Fingerprint128(unsized_.data(), unsized_.size());
+        }
+
+        if (!streaming_) {
+            return Fingerprint128(buffer_, pending_);
+        }
+
+        // The tail is read backwards from its end, reaching into the last block.
+
+        return CityHash128End(state_, buffer_ + 128, pending_);
+
+    }
+
+}
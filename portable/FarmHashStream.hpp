@@ -0,0 +1,88 @@
+// Incremental computation of `FarmHash::Fingerprint128`.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// `CityHash128` mixes the total length into its state before the first block
+// (`z = len * k1`) and reads its tail backwards from the end of the input, so
+// the result of `Final()` can only be produced in constant space if the total
+// length is declared up front.  Declare it whenever you can:
+//
+//     FarmHash::Fingerprint128Stream stream(content_length);
+//     while (...) stream.Update(chunk, chunk_length);
+//     UInt128 fingerprint = stream.Final();
+//
+// With a declared length the stream keeps 256 bytes of buffer (the last block
+// seen, for the tail, and the partial block being filled) plus 56 bytes of hash
+// state, regardless of the input length.  Without one, the input is
+// accumulated in memory and hashed in one go by `Final()`.
+//
+#ifndef FARM_HASH_STREAM_HPP
+#define FARM_HASH_STREAM_HPP
+
+#include "FarmHash.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <vector>
+
+namespace FarmHash {
+
+    class Fingerprint128Stream {
+
+    public:
+
+        Fingerprint128Stream();
+        explicit Fingerprint128Stream(uint64_t length);
+
+        void Update(const uint8_t *input, size_t length);
+        void Update(const int8_t *input, size_t length) { Update((uint8_t *)input, length); }
+
+        // Equal to `Fingerprint128()` of everything passed to `Update()`.  If a
+        // length was declared, exactly that many bytes must have been passed:
+        // bytes beyond it are dropped, and `Final()` of a stream that is not
+        // `Complete()` is `UInt128(0, 0)`.
+
+        UInt128 Final() const;
+        bool Complete() const { return !overrun_ && (!sized_ || consumed_ == length_); }
+
+    private:
+
+        void Block(const uint8_t *block);
+
+        bool sized_;             // was the total length declared?
+        bool streaming_;         // ... and is it long enough for the CityHash128 main loop?
+        bool seeded_;
+        bool overrun_;           // was 'Update()' passed more than the declared length?
+        uint64_t length_;        // declared total length
+        uint64_t consumed_;      // bytes passed to 'Update()' so far
+        uint64_t blocks_;        // main-loop blocks still to come
+        size_t pending_;         // bytes waiting in 'buffer_ + 128'
+        UInt128 seed_;
+        detail::CityHash128State state_;
+        uint8_t buffer_[256];    // the last block consumed, then the partial block being filled
+        std::vector<uint8_t> unsized_;
+
+    };
+
+}
+
+#endif // ! FARM_HASH_STREAM_HPP
@@ -0,0 +1,102 @@
+// A parallel, tree-structured variant of `Fingerprint128` for very large inputs.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FarmHashTree.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <vector>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    namespace {
+
+        void Digest(const uint8_t *input, size_t length, size_t chunk_size, size_t i, uint8_t *digests) {
+            size_t offset = i * chunk_size;
+            UInt128 h = Fingerprint128(input + offset, std::min(chunk_size, length - offset));
+            uint64_t lo = uint64_in_little_endian_order(UInt128Low64(h));
+            uint64_t hi = uint64_in_little_endian_order(UInt128High64(h));
+            std::memcpy(digests + 16 * i, &lo, 8);
+            std::memcpy(digests + 16 * i + 8, &hi, 8);
+        }
+
+        // Without a pool, the pieces are hashed on the calling thread.
+
+        UInt128 Tree(const uint8_t *input, size_t length, size_t chunk_size, ThreadPool *pool) {
+
+            if (chunk_size == 0) {
+                return UInt128(0, 0);
+            }
+
+            size_t pieces = length == 0 ? 1 : 1 + (length - 1) / chunk_size;
+            std::vector<uint8_t> digests(16 * pieces);
+
+            if (pool && pieces > 1) {
+
+                // A handful of pieces per task amortizes the task overhead for
+                // small chunk sizes while leaving plenty to steal.
+
+                size_t grain = std::max<size_t>(1, (256 * 1024) / chunk_size);
+
+                pool->ParallelFor(0, pieces, grain, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        Digest(input, length, chunk_size, i, digests.data());
+                    }
+                });
+
+            } else {
+                for (size_t i = 0; i < pieces; i++) {
+                    Digest(input, length, chunk_size, i, digests.data());
+                }
+            }
+
+            UInt128 seed(Hash128to64(UInt128(length, chunk_size)), Hash128to64(UInt128(kFingerprint128TreeVersion, pieces)));
+
+            return CityHash128WithSeed(digests.data(), digests.size(), seed);
+
+        }
+
+    }
+
+    UInt128 Fingerprint128Tree(const uint8_t *input, size_t length, size_t chunk_size, ThreadPool &pool) {
+        return Tree(input, length, chunk_size, &pool);
+    }
+
+    UInt128 Fingerprint128Tree(const uint8_t *input, size_t length, size_t chunk_size, unsigned threads) {
+
+        // Not worth starting any threads for a single piece.
+
+        if (length <= chunk_size || chunk_size == 0) {
+            return Tree(input, length, chunk_size, 0);
+        }
+
+        ThreadPool pool(threads);
+        return Tree(input, length, chunk_size, &pool);
+
+    }
+
+}
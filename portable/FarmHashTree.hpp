@@ -0,0 +1,57 @@
+// A parallel, tree-structured variant of `Fingerprint128` for very large inputs.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// THIS IS NOT `Fingerprint128`.  The input is cut into `chunk_size` pieces (the
+// last one possibly shorter), each piece is fingerprinted on its own, and the
+// root is `CityHash128WithSeed()` of the concatenated little-endian piece
+// fingerprints, seeded with `Hash128to64()` of the total length and chunk size
+// and of the format version and number of pieces.
+//
+// The result depends on the input, `chunk_size` and `kFingerprint128TreeVersion`
+// only; never on the number of threads.  Any change to the construction above
+// must bump the version.
+//
+// A `chunk_size` of 0 is rejected: the result is then `UInt128(0, 0)`.
+//
+#ifndef FARM_HASH_TREE_HPP
+#define FARM_HASH_TREE_HPP
+
+#include "FarmHash.hpp"
+#include "ThreadPool.hpp"
+
+namespace FarmHash {
+
+    const uint32_t kFingerprint128TreeVersion = 1;
+
+    const size_t kFingerprint128TreeChunk = 1024 * 1024;
+
+    // With `threads == 0`, one thread per core.
+
+    UInt128 Fingerprint128Tree(const uint8_t *input, size_t length, size_t chunk_size = kFingerprint128TreeChunk, unsigned threads = 0);
+
+    UInt128 Fingerprint128Tree(const uint8_t *input, size_t length, size_t chunk_size, ThreadPool &pool);
+
+}
+
+#endif // ! FARM_HASH_TREE_HPP
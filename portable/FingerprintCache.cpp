@@ -0,0 +1,498 @@
+// A persistent cache of file fingerprints, keyed by file identity and metadata.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FingerprintCache.hpp"
+#include "FarmHash.hpp"
+#include "FarmHashDetail.hpp"
+#include "FarmHashFile.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    namespace {
+
+        // The header is the magic, then the version as a little-endian word,
+        // zero-padded to 64 bytes.  Each record is eight little-endian words:
+        // the key (device, inode, size, mtime), the fingerprint (low, high),
+        // zero, and a check word over the rest that is never zero.
+
+        const size_t kHeaderSize = 64;
+        const size_t kRecordSize = 64;
+        const size_t kKeyWords = 4;
+        const char kMagic[8] = { 'F', 'H', 'C', 'a', 'c', 'h', 'e', 0 };
+
+        // The file grows by this many records at a time, within a mapping of
+        // 'kReserve' bytes that never moves.
+
+        const uint64_t kGrowRecords = 16 * 1024;
+        const size_t kReserve = sizeof(void *) >= 8 ? size_t(1) << 36 : size_t(1) << 28;
+
+        // 'Open()' compacts logs of at least this many records if more than
+        // half of them are superseded.
+
+        const uint64_t kCompactRecords = 1024;
+
+        // Files modified this recently are not cached.
+
+        const int64_t kRacyNanoseconds = 1000000000;
+
+        void Store64(uint64_t value, uint8_t *out) {
+            for (int i = 0; i < 8; i++) {
+                out[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        int64_t Nanoseconds(const struct timespec &t) {
+            return static_cast<int64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+        }
+
+        void KeyOf(const struct stat &st, uint64_t *key) {
+            key[0] = static_cast<uint64_t>(st.st_dev);
+            key[1] = static_cast<uint64_t>(st.st_ino);
+            key[2] = static_cast<uint64_t>(st.st_size);
+        #if defined(__APPLE__)
+            key[3] = static_cast<uint64_t>(Nanoseconds(st.st_mtimespec));
+        #else
+            key[3] = static_cast<uint64_t>(Nanoseconds(st.st_mtim));
+        #endif
+        }
+
+        bool IsRacy(const uint64_t *key) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            return static_cast<int64_t>(key[3]) > Nanoseconds(now) - kRacyNanoseconds;
+        }
+
+        uint64_t CheckWord(const uint8_t *record) {
+            return UInt128Low64(Fingerprint128(record, kRecordSize - 8)) | 1;
+        }
+
+        inline const uint8_t *RecordAt(const uint8_t *base, uint64_t i) {
+            return base + kHeaderSize + i * kRecordSize;
+        }
+
+        // Maps 'kReserve' bytes of 'fd', most of them beyond its end for now.
+
+        uint8_t *Reserve(int fd) {
+            void *base = mmap(0, kReserve, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            return base == MAP_FAILED ? 0 : static_cast<uint8_t *>(base);
+        }
+
+        // Lock 'fd', and make sure it is still the file at 'path' once locked:
+        // another process may have compacted it away while we waited.
+
+        bool LockFile(int fd, const char *path) {
+            if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+                return false;
+            }
+            struct stat held, named;
+            if (fstat(fd, &held) != 0 || stat(path, &named) != 0) {
+                return false;
+            }
+            if (held.st_dev != named.st_dev || held.st_ino != named.st_ino) {
+                errno = EWOULDBLOCK;
+                return false;
+            }
+            return true;
+        }
+
+    }
+
+    // -----------------------------------------------------------------
+    // The index from '(device, inode)' to the newest record for it.  Slots
+    // hold a record number plus one, or zero if free; they only ever go from
+    // free to used, or from one record for a file to a newer one.
+
+    struct FingerprintCache::Table {
+
+        Table(const uint8_t *records, uint64_t slots) : base(records), mask(slots - 1), slot(new std::atomic<uint64_t>[slots]), used(0) {
+            for (uint64_t i = 0; i < slots; i++) {
+                slot[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        static uint64_t Home(uint64_t device, uint64_t inode) {
+            return Hash128to64(UInt128(device, inode));
+        }
+
+        // The slot for '(device, inode)': the one naming a record for it, or
+        // else the free one that ends its probe sequence.
+
+        std::atomic<uint64_t> &Find(uint64_t device, uint64_t inode, uint64_t &record) const {
+            for (uint64_t i = Home(device, inode) & mask; ; i = (i + 1) & mask) {
+                record = slot[i].load(std::memory_order_acquire);
+                if (record == 0) {
+                    return slot[i];
+                }
+                const uint8_t *r = RecordAt(base, record - 1);
+                if (Fetch64(r) == device && Fetch64(r + 8) == inode) {
+                    return slot[i];
+                }
+            }
+        }
+
+        // Writers only, with a free slot to spare.
+
+        void Set(uint64_t record) {
+            const uint8_t *r = RecordAt(base, record);
+            uint64_t old;
+            std::atomic<uint64_t> &s = Find(Fetch64(r), Fetch64(r + 8), old);
+            if (old == 0) {
+                used.store(used.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            s.store(record + 1, std::memory_order_release);
+        }
+
+        bool Full() const {
+            return 2 * (used.load(std::memory_order_relaxed) + 1) > mask + 1;
+        }
+
+        const uint8_t *base;
+        uint64_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slot;
+        std::atomic<size_t> used;
+
+    };
+
+    // -----------------------------------------------------------------
+
+    FingerprintCache::FingerprintCache() : fd_(-1), base_(0), reserved_(0), records_(0), capacity_(0), table_(0), verify_every_(0), hits_(0), misses_(0), mismatches_(0) {}
+
+    FingerprintCache::~FingerprintCache() {
+        Close();
+    }
+
+    void FingerprintCache::Close() {
+        for (size_t i = 0; i < mappings_.size(); i++) {
+            munmap(mappings_[i].first, mappings_[i].second);
+        }
+        mappings_.clear();
+        table_.store(0);
+        tables_.clear();
+        if (fd_ >= 0) {
+            munmap(base_, reserved_);
+            if (ftruncate(fd_, kHeaderSize + records_ * kRecordSize) != 0) {
+                // the padding stays; it reads as the end of the log
+            }
+            close(fd_);
+        }
+        fd_ = -1;
+        base_ = 0;
+        reserved_ = 0;
+        records_ = capacity_ = 0;
+    }
+
+    bool FingerprintCache::Open(const char *path) {
+        Close();
+        int fd = open(path, O_RDWR | O_CREAT, 0666);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (!LockFile(fd, path) || fstat(fd, &st) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        bool fresh = st.st_size == 0;
+        uint64_t capacity = fresh ? kGrowRecords : (static_cast<uint64_t>(st.st_size) - kHeaderSize) / kRecordSize;
+        if (fresh && ftruncate(fd, kHeaderSize + capacity * kRecordSize) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        uint8_t *base = Reserve(fd);
+        if (!base) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        if (fresh) {
+            memcpy(base, kMagic, 8);
+            Store64(kFingerprintCacheVersion, base + 8);
+        } else if (static_cast<uint64_t>(st.st_size) < kHeaderSize || memcmp(base, kMagic, 8) != 0 || Fetch64(base + 8) != kFingerprintCacheVersion || capacity * kRecordSize > kReserve - kHeaderSize) {
+            munmap(base, kReserve);
+            close(fd);
+            errno = EINVAL;
+            return false;
+        }
+
+        path_ = path;
+        fd_ = fd;
+        base_ = base;
+        reserved_ = kReserve;
+        capacity_ = capacity;
+        records_ = 0;
+        while (records_ < capacity_) {
+            const uint8_t *r = RecordAt(base_, records_);
+            if (Fetch64(r + kRecordSize - 8) != CheckWord(r)) {
+                break;
+            }
+            records_++;
+        }
+        uint64_t slots = 16;
+        while (slots < 2 * records_ + 2) {
+            slots *= 2;
+        }
+        tables_.push_back(std::unique_ptr<Table>(new Table(base_, slots)));
+        Table *table = tables_.back().get();
+        for (uint64_t i = 0; i < records_; i++) {
+            table->Set(i);
+        }
+        table_.store(table, std::memory_order_release);
+
+        if (records_ >= kCompactRecords && 2 * table->used.load() < records_) {
+            return Compact();
+        }
+        return true;
+    }
+
+    // -----------------------------------------------------------------
+
+    bool FingerprintCache::Lookup(const struct stat &st, UInt128 &fingerprint) const {
+        const Table *table = table_.load(std::memory_order_acquire);
+        if (!table) {
+            return false;
+        }
+        uint64_t key[kKeyWords], record;
+        KeyOf(st, key);
+        table->Find(key[0], key[1], record);
+        if (record == 0) {
+            return false;
+        }
+        const uint8_t *r = RecordAt(table->base, record - 1);
+        if (Fetch64(r + 16) != key[2] || Fetch64(r + 24) != key[3]) {
+            return false;
+        }
+        fingerprint = UInt128(Fetch64(r + 32), Fetch64(r + 40));
+        return true;
+    }
+
+    bool FingerprintCache::Insert(const struct stat &st, const UInt128 &fingerprint) {
+        uint64_t key[kKeyWords];
+        KeyOf(st, key);
+        return Append(key, fingerprint);
+    }
+
+    bool FingerprintCache::Append(const uint64_t *key, const UInt128 &fingerprint) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Table *table = table_.load(std::memory_order_relaxed);
+        if (!table) {
+            errno = EBADF;
+            return false;
+        }
+        uint64_t record;
+        table->Find(key[0], key[1], record);
+        if (record != 0) {
+            const uint8_t *r = RecordAt(table->base, record - 1);
+            if (Fetch64(r + 16) == key[2] && Fetch64(r + 24) == key[3] && Fetch64(r + 32) == UInt128Low64(fingerprint) && Fetch64(r + 40) == UInt128High64(fingerprint)) {
+                return true;
+            }
+        }
+        if (records_ == capacity_) {
+            uint64_t capacity = capacity_ + kGrowRecords;
+            if (kHeaderSize + capacity * kRecordSize > reserved_) {
+                errno = EFBIG;
+                return false;
+            }
+            if (ftruncate(fd_, kHeaderSize + capacity * kRecordSize) != 0) {
+                return false;
+            }
+            capacity_ = capacity;
+        }
+
+        uint8_t *r = base_ + kHeaderSize + records_ * kRecordSize;
+        for (size_t i = 0; i < kKeyWords; i++) {
+            Store64(key[i], r + 8 * i);
+        }
+        Store64(UInt128Low64(fingerprint), r + 32);
+        Store64(UInt128High64(fingerprint), r + 40);
+        Store64(0, r + 48);
+        Store64(CheckWord(r), r + 56);
+
+        if (table->Full()) {
+            tables_.push_back(std::unique_ptr<Table>(new Table(base_, 2 * (table->mask + 1))));
+            Table *grown = tables_.back().get();
+            for (uint64_t i = 0; i <= table->mask; i++) {
+                uint64_t old = table->slot[i].load(std::memory_order_relaxed);
+                if (old) {
+                    grown->Set(old - 1);
+                }
+            }
+            table_.store(grown, std::memory_order_release);
+            table = grown;
+        }
+        table->Set(records_++);
+        return true;
+    }
+
+    bool FingerprintCache::Compact() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Table *table = table_.load(std::memory_order_relaxed);
+        if (!table) {
+            errno = EBADF;
+            return false;
+        }
+        std::string temporary = path_ + ".compact";
+        int fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            return false;
+        }
+        uint64_t live = table->used.load(std::memory_order_relaxed);
+        uint64_t capacity = live + kGrowRecords;
+        uint8_t *base = 0;
+        if (!LockFile(fd, temporary.c_str()) || ftruncate(fd, kHeaderSize + capacity * kRecordSize) != 0 || !(base = Reserve(fd))) {
+            int error = errno;
+            close(fd);
+            unlink(temporary.c_str());
+            errno = error;
+            return false;
+        }
+        memcpy(base, kMagic, 8);
+        Store64(kFingerprintCacheVersion, base + 8);
+        uint64_t records = 0;
+        for (uint64_t i = 0; i <= table->mask; i++) {
+            uint64_t old = table->slot[i].load(std::memory_order_relaxed);
+            if (old) {
+                memcpy(base + kHeaderSize + records++ * kRecordSize, RecordAt(table->base, old - 1), kRecordSize);
+            }
+        }
+        if (msync(base, kHeaderSize + records * kRecordSize, MS_SYNC) != 0 || fsync(fd) != 0 || rename(temporary.c_str(), path_.c_str()) != 0) {
+            int error = errno;
+            munmap(base, kReserve);
+            close(fd);
+            unlink(temporary.c_str());
+            errno = error;
+            return false;
+        }
+
+        uint64_t slots = table->mask + 1;
+        tables_.push_back(std::unique_ptr<Table>(new Table(base, slots)));
+        Table *compacted = tables_.back().get();
+        for (uint64_t i = 0; i < records; i++) {
+            compacted->Set(i);
+        }
+        table_.store(compacted, std::memory_order_release);
+
+        // Lookups may still be reading the old mapping.
+        mappings_.push_back(std::make_pair(base_, reserved_));
+        close(fd_);
+        fd_ = fd;
+        base_ = base;
+        reserved_ = kReserve;
+        records_ = records;
+        capacity_ = capacity;
+        return true;
+    }
+
+    bool FingerprintCache::Sync() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ < 0) {
+            errno = EBADF;
+            return false;
+        }
+        return msync(base_, kHeaderSize + records_ * kRecordSize, MS_SYNC) == 0 && fsync(fd_) == 0;
+    }
+
+    size_t FingerprintCache::Size() const {
+        const Table *table = table_.load(std::memory_order_acquire);
+        return table ? table->used.load(std::memory_order_relaxed) : 0;
+    }
+
+    // -----------------------------------------------------------------
+
+    bool FingerprintCache::Fingerprint(const char *path, UInt128 &fingerprint) {
+        return Fingerprint(path, fingerprint, static_cast<ThreadPool *>(0));
+    }
+
+    bool FingerprintCache::Fingerprint(const char *path, UInt128 &fingerprint, ThreadPool &pool) {
+        return Fingerprint(path, fingerprint, &pool);
+    }
+
+    bool FingerprintCache::Fingerprint(const char *path, UInt128 &fingerprint, ThreadPool *pool) {
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            return false;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            return pool ? FingerprintFile(path, fingerprint, *pool) : FingerprintFile(path, fingerprint);
+        }
+        if (!Lookup(st, fingerprint)) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return Hash(path, fingerprint, pool);
+        }
+        uint64_t every = verify_every_, hit = hits_.fetch_add(1, std::memory_order_relaxed);
+        if (every == 0 || hit % every != every - 1) {
+            return true;
+        }
+        UInt128 cached = fingerprint;
+        if (!Hash(path, fingerprint, pool)) {
+            return false;
+        }
+        if (fingerprint != cached) {
+            mismatches_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Hash the file, and cache the result if the file did not change meanwhile.
+
+    bool FingerprintCache::Hash(const char *path, UInt128 &fingerprint, ThreadPool *pool) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat before, after;
+        bool ok = fstat(fd, &before) == 0 && (pool ? FingerprintFd(fd, fingerprint, *pool) : FingerprintFd(fd, fingerprint)) && fstat(fd, &after) == 0;
+        int error = errno;
+        close(fd);
+        if (!ok) {
+            errno = error;
+            return false;
+        }
+        uint64_t key[kKeyWords], changed[kKeyWords];
+        KeyOf(before, key);
+        KeyOf(after, changed);
+        if (S_ISREG(after.st_mode) && memcmp(key, changed, sizeof(key)) == 0 && !IsRacy(key)) {
+            Append(key, fingerprint);   // a cache that cannot grow is still a cache
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,144 @@
+// A persistent cache of file fingerprints, keyed by file identity and metadata.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// `FingerprintCache` remembers the `Fingerprint128()` of files it has hashed
+// in an on-disk index, keyed by `(device, inode, size, mtime in nanoseconds)`.
+// A file whose key is unchanged gets its cached fingerprint back for the cost
+// of a `stat()`, without being read.
+//
+// The index is an append-only log of 64-byte records, each carrying its own
+// check word, behind a 64-byte header.  It is memory-mapped once, with room to
+// grow in place, and looked up through an in-memory open-addressing table from
+// `(device, inode)` to the newest record for it.  Lookups take no lock, and
+// may run alongside `Fingerprint()` and `Compact()` on other threads; records
+// are appended under a mutex.  A record torn by a crash ends the log when it
+// is next opened.  `Compact()` rewrites the log with only the newest record
+// per file, and replaces the old one by `rename()`; `Open()` compacts when
+// more than half the log is superseded records.
+//
+// A file modified twice within the granularity of its timestamps can keep the
+// same key with different contents.  Files whose mtime is within a second of
+// the time they were hashed are therefore not cached, and one cache hit in
+// every `SetVerifyEvery()` (none by default) is hashed again; a mismatch
+// replaces the cached fingerprint.
+//
+// One process at a time: `Open()` takes an exclusive `flock()` on the index,
+// and fails with `EWOULDBLOCK` if another holds it.
+//
+// POSIX only.  The functions returning `bool` return `false`, with `errno`
+// set, on failure.
+//
+#ifndef FINGERPRINT_CACHE_HPP
+#define FINGERPRINT_CACHE_HPP
+
+#include "UInt128.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace FarmHash {
+
+    const uint32_t kFingerprintCacheVersion = 1;
+
+    class FingerprintCache {
+
+    public:
+
+        FingerprintCache();
+        ~FingerprintCache();
+
+        // Opens the index at `path`, creating it if need be.
+
+        bool Open(const char *path);
+        bool Open(const std::string &path) { return Open(path.c_str()); }
+
+        // `Fingerprint128()` of the contents of the file at `path`: cached if
+        // its key is, and otherwise hashed (on `pool`, if given) and cached.
+        // Files other than regular files are hashed but never cached.
+
+        bool Fingerprint(const char *path, UInt128 &fingerprint);
+        bool Fingerprint(const char *path, UInt128 &fingerprint, ThreadPool &pool);
+        bool Fingerprint(const std::string &path, UInt128 &fingerprint) { return Fingerprint(path.c_str(), fingerprint); }
+        bool Fingerprint(const std::string &path, UInt128 &fingerprint, ThreadPool &pool) { return Fingerprint(path.c_str(), fingerprint, pool); }
+
+        // The cached fingerprint of the file `st` describes, if any.
+
+        bool Lookup(const struct stat &st, UInt128 &fingerprint) const;
+
+        // Caches `fingerprint` for the file `st` describes.
+
+        bool Insert(const struct stat &st, const UInt128 &fingerprint);
+
+        bool Compact();
+
+        // Flushes the index to disk; otherwise that happens as the system sees fit.
+
+        bool Sync();
+
+        // Re-hash one cache hit in every `every` (never, if zero).
+
+        void SetVerifyEvery(uint64_t every) { verify_every_ = every; }
+
+        size_t Size() const;    // files cached
+        uint64_t Hits() const { return hits_.load(std::memory_order_relaxed); }
+        uint64_t Misses() const { return misses_.load(std::memory_order_relaxed); }
+        uint64_t Mismatches() const { return mismatches_.load(std::memory_order_relaxed); }
+
+    private:
+
+        struct Table;
+
+        FingerprintCache(const FingerprintCache &);
+        FingerprintCache &operator=(const FingerprintCache &);
+
+        bool Fingerprint(const char *path, UInt128 &fingerprint, ThreadPool *pool);
+        bool Hash(const char *path, UInt128 &fingerprint, ThreadPool *pool);
+        bool Append(const uint64_t *key, const UInt128 &fingerprint);
+        bool Map(int fd, uint64_t records);
+        void Close();
+
+        std::string path_;
+        int fd_;
+        uint8_t *base_;                         // the mapping of 'fd_', of 'reserved_' bytes
+        size_t reserved_;
+        uint64_t records_;                      // in the log, live or superseded
+        uint64_t capacity_;                     // records the file has room for
+        std::atomic<Table *> table_;
+        std::vector<std::unique_ptr<Table> > tables_;              // the current one and those retired
+        std::vector<std::pair<uint8_t *, size_t> > mappings_;     // retired by 'Compact()'
+        std::mutex mutex_;                      // held by writers
+        uint64_t verify_every_;
+        std::atomic<uint64_t> hits_, misses_, mismatches_;
+
+    };
+
+}
+
+#endif // ! FINGERPRINT_CACHE_HPP
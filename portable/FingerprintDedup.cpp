@@ -0,0 +1,288 @@
+// External-memory duplicate detection over more fingerprints than fit in memory.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FingerprintDedup.hpp"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    namespace {
+
+        // The radix sort's digits: six passes of 11 bits cover the low word.
+
+        const unsigned kDigitBits = 11;
+        const unsigned kPasses = (64 + kDigitBits - 1) / kDigitBits;
+        const size_t kDigits = size_t(1) << kDigitBits;
+
+        // Partitions larger than this are split before sorting, and pieces
+        // smaller than 'kSmallSort' are not worth a histogram.
+
+        const size_t kCachedEntries = 32 * 1024;
+        const size_t kSmallSort = 256;
+
+        bool WriteFully(int fd, const uint8_t *buffer, size_t length, uint64_t offset) {
+            while (length > 0) {
+                ssize_t n = pwrite(fd, buffer, length, offset);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                buffer += n;
+                length -= n;
+                offset += n;
+            }
+            return true;
+        }
+
+        bool ReadFully(int fd, uint8_t *buffer, size_t length, uint64_t offset) {
+            while (length > 0) {
+                ssize_t n = pread(fd, buffer, length, offset);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                if (n == 0) {
+                    errno = EIO;
+                    return false;
+                }
+                buffer += n;
+                length -= n;
+                offset += n;
+            }
+            return true;
+        }
+
+        // Sort by the 'low' member, stably, leaving the result in 'a' or 'b'.
+
+        template <typename Entry>
+        Entry *RadixSortLow(Entry *a, Entry *b, size_t n, std::vector<size_t> &counts) {
+            if (n < kSmallSort) {
+                std::sort(a, a + n, [](const Entry &x, const Entry &y) { return x.low < y.low; });
+                return a;
+            }
+            counts.assign(kPasses * kDigits, 0);
+            for (size_t i = 0; i < n; i++) {
+                for (unsigned p = 0; p < kPasses; p++) {
+                    counts[p * kDigits + ((a[i].low >> (p * kDigitBits)) & (kDigits - 1))]++;
+                }
+            }
+            for (unsigned p = 0; p < kPasses; p++) {
+                size_t *count = &counts[p * kDigits];
+                unsigned shift = p * kDigitBits;
+                if (n == 0 || count[(a[0].low >> shift) & (kDigits - 1)] == n) {
+                    continue;       // every entry has the same digit
+                }
+                for (size_t d = 0, sum = 0; d < kDigits; d++) {
+                    size_t c = count[d];
+                    count[d] = sum;
+                    sum += c;
+                }
+                for (size_t i = 0; i < n; i++) {
+                    b[count[(a[i].low >> shift) & (kDigits - 1)]++] = a[i];
+                }
+                std::swap(a, b);
+            }
+            return a;
+        }
+
+    }
+
+    FingerprintDedup::FingerprintDedup(unsigned partition_bits, size_t page_bytes)
+        : shift_(64 - partition_bits), page_entries_(std::max<size_t>(1, page_bytes / sizeof(Entry))), fd_(-1), end_(0), added_(0), error_(0)
+    {
+        assert(partition_bits >= 1 && partition_bits <= 24);
+        partitions_.resize(size_t(1) << partition_bits);
+        for (size_t i = 0; i < partitions_.size(); i++) {
+            partitions_[i].reset(new Partition);
+        }
+    }
+
+    FingerprintDedup::~FingerprintDedup() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool FingerprintDedup::Open(const char *directory) {
+        std::string path = std::string(directory) + "/farmhash-dedup-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back(0);
+        int fd = mkstemp(name.data());
+        if (fd < 0) {
+            return false;
+        }
+        unlink(name.data());
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        fd_ = fd;
+        return true;
+    }
+
+    bool FingerprintDedup::Fail(int error) {
+        int none = 0;
+        error_.compare_exchange_strong(none, error);
+        errno = error;
+        return false;
+    }
+
+    bool FingerprintDedup::Add(const UInt128 &fingerprint, uint64_t id) {
+        if (int error = error_.load(std::memory_order_relaxed)) {
+            errno = error;
+            return false;
+        }
+        Partition &partition = *partitions_[UInt128High64(fingerprint) >> shift_];
+        Entry entry = { UInt128Low64(fingerprint), UInt128High64(fingerprint), id };
+        std::unique_lock<std::mutex> lock(partition.mutex);
+        if (partition.buffer.empty()) {
+            partition.buffer.reserve(page_entries_);
+        }
+        partition.buffer.push_back(entry);
+        added_.fetch_add(1, std::memory_order_relaxed);
+        return partition.buffer.size() < page_entries_ || Spill(partition, lock);
+    }
+
+    // Write out the partition's buffer, without holding its lock while writing.
+
+    bool FingerprintDedup::Spill(Partition &partition, std::unique_lock<std::mutex> &lock) {
+        std::vector<Entry> page;
+        page.swap(partition.buffer);
+        size_t bytes = page.size() * sizeof(Entry);
+        Page written = { end_.fetch_add(bytes), page.size() };
+        partition.pages.push_back(written);
+        lock.unlock();
+        if (fd_ < 0) {
+            return Fail(EBADF);
+        }
+        if (!WriteFully(fd_, reinterpret_cast<const uint8_t *>(page.data()), bytes, written.offset)) {
+            return Fail(errno);
+        }
+        return true;
+    }
+
+    bool FingerprintDedup::Finish(ThreadPool &pool, const GroupCallback &group) {
+        pool.ParallelFor(0, partitions_.size(), 1, [this, &group](size_t i, size_t j) {
+            for (; i < j; i++) {
+                if (error_.load(std::memory_order_relaxed) == 0) {
+                    Process(*partitions_[i], group);
+                }
+            }
+        });
+        if (int error = error_.load()) {
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+
+    bool FingerprintDedup::Process(Partition &partition, const GroupCallback &group) {
+        size_t n = partition.buffer.size();
+        for (size_t p = 0; p < partition.pages.size(); p++) {
+            n += partition.pages[p].entries;
+        }
+        std::vector<Entry> entries(n), scratch(n);
+        Entry *e = entries.data();
+        for (size_t p = 0; p < partition.pages.size(); p++) {
+            const Page &page = partition.pages[p];
+            if (!ReadFully(fd_, reinterpret_cast<uint8_t *>(e), page.entries * sizeof(Entry), page.offset)) {
+                return Fail(errno);
+            }
+            e += page.entries;
+        }
+        std::copy(partition.buffer.begin(), partition.buffer.end(), e);
+        std::vector<Entry>().swap(partition.buffer);
+        std::vector<Page>().swap(partition.pages);
+
+        // Large partitions are first split by up to 11 more bits of the high
+        // word, so that each piece is sorted in cache.  Equal fingerprints
+        // stay together.
+
+        std::vector<size_t> counts;
+        if (n <= kCachedEntries) {
+            Report(RadixSortLow(entries.data(), scratch.data(), n, counts), n, group);
+            return true;
+        }
+        unsigned bits = 1;
+        while (bits < kDigitBits && (n >> bits) > kCachedEntries) {
+            bits++;
+        }
+        size_t pieces = size_t(1) << bits;
+        unsigned shift = shift_ - bits;
+        std::vector<size_t> begin(pieces + 1);
+        for (size_t i = 0; i < n; i++) {
+            begin[((entries[i].high >> shift) & (pieces - 1)) + 1]++;
+        }
+        for (size_t d = 0; d < pieces; d++) {
+            begin[d + 1] += begin[d];
+        }
+        std::vector<size_t> next(begin.begin(), begin.end() - 1);
+        for (size_t i = 0; i < n; i++) {
+            scratch[next[(entries[i].high >> shift) & (pieces - 1)]++] = entries[i];
+        }
+        for (size_t d = 0; d < pieces; d++) {
+            size_t m = begin[d + 1] - begin[d];
+            Report(RadixSortLow(scratch.data() + begin[d], entries.data() + begin[d], m, counts), m, group);
+        }
+        return true;
+    }
+
+    // Runs of equal low words are almost always true duplicates; sort each by
+    // high word and id to split off the rest and order the ids.
+
+    void FingerprintDedup::Report(Entry *sorted, size_t n, const GroupCallback &group) {
+        std::vector<uint64_t> ids;
+        for (size_t i = 0, j; i < n; i = j) {
+            for (j = i + 1; j < n && sorted[j].low == sorted[i].low; j++) {
+            }
+            if (j - i < 2) {
+                continue;
+            }
+            std::sort(sorted + i, sorted + j, [](const Entry &x, const Entry &y) { return x.high != y.high ? x.high < y.high : x.id < y.id; });
+            for (size_t k = i, l; k < j; k = l) {
+                ids.clear();
+                for (l = k; l < j && sorted[l].high == sorted[k].high; l++) {
+                    ids.push_back(sorted[l].id);
+                }
+                if (ids.size() >= 2) {
+                    std::lock_guard<std::mutex> lock(group_mutex_);
+                    group(UInt128(sorted[k].low, sorted[k].high), ids.data(), ids.size());
+                }
+            }
+        }
+    }
+
+}
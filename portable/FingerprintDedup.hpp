@@ -0,0 +1,137 @@
+// External-memory duplicate detection over more fingerprints than fit in memory.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// `FingerprintDedup` finds the records that share a fingerprint among any
+// number of them, in memory proportional to the largest partition rather than
+// to the whole input.  Records are added as `(fingerprint, id)` pairs, from
+// any number of threads:
+//
+//     FarmHash::FingerprintDedup dedup;
+//     dedup.Open("/scratch");
+//     pool.ParallelFor(0, n, 4096, [&](size_t i, size_t j) {
+//         for (; i < j; i++) dedup.Add(record[i], length[i], i);
+//     });
+//     dedup.Finish(pool, [](const UInt128 &fingerprint, const uint64_t *ids, size_t n) { ... });
+//
+// Each pair is 24 bytes, and goes to one of `2^partition_bits` partitions by
+// the top bits of its fingerprint.  A partition buffers a page of pairs in
+// memory; the thread that fills it takes a slot at the end of one shared,
+// already unlinked spill file and writes the page there, so writes are large
+// and sequential, and several can be in flight.
+//
+// `Finish()` then reads one partition per pool task, splits it by up to 11 more
+// bits of the high word into pieces that fit in cache, sorts each piece by the
+// low word with an LSD radix sort (six passes of 11 bits), and reports each group of
+// two or more ids with an equal fingerprint, the rare runs of equal low words
+// being split exactly by the high word.  Groups are reported one at a time,
+// in no particular order, with their ids in ascending order.
+//
+// Memory is `2^partition_bits` pages while adding, and twice the largest
+// partition per pool thread (plus the caller) while finishing.  For 10^10
+// records (240 GB) the defaults, 1024 partitions of 256 KiB pages, use 256 MiB
+// to add and about 470 MiB per thread to finish; raise `partition_bits` for
+// more, or for fewer threads' worth of memory.
+//
+// POSIX only.  The functions returning `bool` return `false`, with `errno`
+// set, on failure; a failed write fails every later call.
+//
+#ifndef FINGERPRINT_DEDUP_HPP
+#define FINGERPRINT_DEDUP_HPP
+
+#include "FarmHash.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace FarmHash {
+
+    class FingerprintDedup {
+
+    public:
+
+        typedef std::function<void(const UInt128 &fingerprint, const uint64_t *ids, size_t n)> GroupCallback;
+
+        explicit FingerprintDedup(unsigned partition_bits = 10, size_t page_bytes = 256 * 1024);
+        ~FingerprintDedup();
+
+        // Creates the spill file in `directory`.
+
+        bool Open(const char *directory);
+        bool Open(const std::string &directory) { return Open(directory.c_str()); }
+
+        bool Add(const UInt128 &fingerprint, uint64_t id);
+
+        bool Add(const uint8_t *record, size_t length, uint64_t id) { return Add(Fingerprint128(record, length), id); }
+
+        // Reports every group of duplicates, once everything has been added.
+        // Nothing may be added afterwards.
+
+        bool Finish(ThreadPool &pool, const GroupCallback &group);
+
+        uint64_t Size() const { return added_.load(std::memory_order_relaxed); }
+
+    private:
+
+        struct Entry {
+            uint64_t low, high, id;
+        };
+
+        struct Page {
+            uint64_t offset;
+            size_t entries;
+        };
+
+        struct Partition {
+            std::mutex mutex;
+            std::vector<Entry> buffer;
+            std::vector<Page> pages;        // written to the spill file
+        };
+
+        FingerprintDedup(const FingerprintDedup &);
+        FingerprintDedup &operator=(const FingerprintDedup &);
+
+        bool Spill(Partition &partition, std::unique_lock<std::mutex> &lock);
+        bool Fail(int error);
+        bool Process(Partition &partition, const GroupCallback &group);
+        void Report(Entry *sorted, size_t n, const GroupCallback &group);
+
+        unsigned shift_;                    // 64 - partition_bits
+        size_t page_entries_;
+        int fd_;
+        std::vector<std::unique_ptr<Partition> > partitions_;
+        std::atomic<uint64_t> end_;         // of the spill file
+        std::atomic<uint64_t> added_;
+        std::atomic<int> error_;            // the first errno, or zero
+        std::mutex group_mutex_;
+
+    };
+
+}
+
+#endif // ! FINGERPRINT_DEDUP_HPP
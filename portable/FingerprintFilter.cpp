@@ -0,0 +1,489 @@
+// Blocked Bloom and cuckoo filters keyed by 128-bit fingerprints.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "FingerprintFilter.hpp"
+#include "FarmHashDetail.hpp"
+
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)) && defined(__x86_64__)
+#   define FINGERPRINT_FILTER_X86_64
+#   include <immintrin.h>
+#endif
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    using namespace detail;
+
+    namespace {
+
+        // Fingerprints whose blocks or buckets are prefetched ahead of the one
+        // being tested by the bulk queries.
+
+        const size_t kPrefetchAhead = 16;
+
+        // Serialization.  The header is the magic, then little-endian words:
+        // the version and the filter's parameters, zero-padded to 64 bytes.
+
+        const size_t kHeaderSize = 64;
+        const char kBloomMagic[8] = { 'F', 'H', 'B', 'l', 'o', 'o', 'm', 0 };
+        const char kCuckooMagic[8] = { 'F', 'H', 'C', 'u', 'c', 'k', 'o', 'o' };
+
+        void Store64(uint64_t value, uint8_t *out) {
+            for (int i = 0; i < 8; i++) {
+                out[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        void SerializeFilter(const char *magic, const uint64_t *params, size_t n_params, const uint64_t *words, size_t n, uint8_t *out) {
+            memset(out, 0, kHeaderSize);
+            memcpy(out, magic, 8);
+            for (size_t i = 0; i < n_params; i++) {
+                Store64(params[i], out + 8 * (i + 1));
+            }
+            for (size_t i = 0; i < n; i++) {
+                Store64(words[i], out + kHeaderSize + 8 * i);
+            }
+        }
+
+        bool LoadHeader(const char *magic, const uint8_t *bytes, size_t size, uint64_t *params, size_t n_params) {
+            if (size < kHeaderSize || memcmp(bytes, magic, 8) != 0) {
+                return false;
+            }
+            for (size_t i = 0; i < n_params; i++) {
+                params[i] = Fetch64(bytes + 8 * (i + 1));
+            }
+            return params[0] == kFingerprintFilterVersion;
+        }
+
+        // The words after the header, in place if they can be read as they are.
+
+        const uint64_t *LoadWords(const uint8_t *bytes, size_t n, std::vector<uint64_t> &copy) {
+            const uint8_t *words = bytes + kHeaderSize;
+        #if !defined(IS_BIG_ENDIAN)
+            if (reinterpret_cast<uintptr_t>(words) % sizeof(uint64_t) == 0) {
+                std::vector<uint64_t>().swap(copy);
+                return reinterpret_cast<const uint64_t *>(words);
+            }
+        #endif
+            copy.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                copy[i] = Fetch64(words + 8 * i);
+            }
+            return 0;
+        }
+
+        bool IsPowerOfTwo(uint64_t x) {
+            return x != 0 && (x & (x - 1)) == 0;
+        }
+
+        // ---------------------------------------------------------------------
+        // Blocked Bloom filter.  Probe 'i' sets bit '(h1 + i * h2) % 512' of the
+        // block, where 'h1' and 'h2' are the halves of the high word; 'h2' is
+        // odd, so the first 512 probes are all different.
+
+        const uint64_t kBlockWords = 8;
+        const uint64_t kBlockBits = 64 * kBlockWords;
+        const unsigned kMaxProbes = 16;
+
+        inline const uint64_t *BlockOf(const uint64_t *words, uint64_t blocks, const UInt128 &fingerprint) {
+            return words + (UInt128Low64(fingerprint) & (blocks - 1)) * kBlockWords;
+        }
+
+        inline uint64_t BlockContains(const uint64_t *block, uint64_t h, unsigned k) {
+            uint64_t h1 = h & 0xFFFFFFFF, h2 = (h >> 32) | 1, found = 1;
+            for (unsigned i = 0; i < k; i++) {
+                uint64_t bit = (h1 + i * h2) & (kBlockBits - 1);
+                found &= block[bit >> 6] >> (bit & 63);
+            }
+            return found;
+        }
+
+        typedef void (*BloomKernel)(const uint64_t *words, uint64_t blocks, unsigned k, const UInt128 *fingerprints, size_t n, bool *out);
+
+        void BloomScalar(const uint64_t *words, uint64_t blocks, unsigned k, const UInt128 *fingerprints, size_t n, bool *out) {
+            for (size_t i = 0; i < n; i++) {
+                if (i + kPrefetchAhead < n) {
+                    Prefetch(BlockOf(words, blocks, fingerprints[i + kPrefetchAhead]));
+                }
+                out[i] = BlockContains(BlockOf(words, blocks, fingerprints[i]), UInt128High64(fingerprints[i]), k) != 0;
+            }
+        }
+
+        // ---------------------------------------------------------------------
+        // Cuckoo filter.  A bucket is one word of four 16-bit tags, and a tag's
+        // other bucket is its bucket xor a hash of the tag (as in Fan et al.),
+        // so either bucket leads to the other.
+
+        const uint64_t kSlots = 4;
+        const uint64_t kTagBits = 16;
+        const uint64_t kTagMask = 0xFFFF;
+        const uint64_t kTagLsbs = 0x0001000100010001ULL;
+        const uint64_t kTagMsbs = 0x8000800080008000ULL;
+        const uint64_t kTagMul = 0x5bd1e995;
+        const int kMaxKicks = 500;
+
+        inline uint64_t TagOf(const UInt128 &fingerprint) {
+            uint64_t tag = UInt128High64(fingerprint) >> (64 - kTagBits);
+            return tag + (tag == 0);
+        }
+
+        inline uint64_t OtherBucket(uint64_t bucket, uint64_t tag, uint64_t mask) {
+            return (bucket ^ (tag * kTagMul)) & mask;
+        }
+
+        inline bool HasTag(uint64_t bucket, uint64_t tag) {
+            uint64_t x = bucket ^ (tag * kTagLsbs);
+            return ((x - kTagLsbs) & ~x & kTagMsbs) != 0;
+        }
+
+        inline bool PutTag(uint64_t &bucket, uint64_t tag) {
+            for (uint64_t slot = 0; slot < kSlots; slot++) {
+                if (((bucket >> (slot * kTagBits)) & kTagMask) == 0) {
+                    bucket |= tag << (slot * kTagBits);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        inline bool RemoveTag(uint64_t &bucket, uint64_t tag) {
+            for (uint64_t slot = 0; slot < kSlots; slot++) {
+                if (((bucket >> (slot * kTagBits)) & kTagMask) == tag) {
+                    bucket &= ~(kTagMask << (slot * kTagBits));
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        typedef void (*CuckooKernel)(const uint64_t *buckets, uint64_t mask, const UInt128 *fingerprints, size_t n, bool *out);
+
+        void CuckooScalar(const uint64_t *buckets, uint64_t mask, const UInt128 *fingerprints, size_t n, bool *out) {
+            for (size_t i = 0; i < n; i++) {
+                if (i + kPrefetchAhead < n) {
+                    const UInt128 &ahead = fingerprints[i + kPrefetchAhead];
+                    uint64_t bucket = UInt128Low64(ahead) & mask;
+                    Prefetch(buckets + bucket);
+                    Prefetch(buckets + OtherBucket(bucket, TagOf(ahead), mask));
+                }
+                uint64_t tag = TagOf(fingerprints[i]), bucket = UInt128Low64(fingerprints[i]) & mask;
+                out[i] = HasTag(buckets[bucket], tag) | HasTag(buckets[OtherBucket(bucket, tag, mask)], tag);
+            }
+        }
+
+        // ---------------------------------------------------------------------
+        // AVX-512: eight fingerprints per vector, each probe a gather.
+
+    #if defined(FINGERPRINT_FILTER_X86_64)
+
+        #if defined(__GNUC__) && !defined(__clang__)
+        #   pragma GCC diagnostic ignored "-Wpsabi"
+        #endif
+
+        typedef uint64_t U64x8 __attribute__((vector_size(64)));
+
+        #define FINGERPRINT_FILTER_ALWAYS_INLINE inline __attribute__((always_inline))
+
+        // The low and high words of eight fingerprints.
+
+        FINGERPRINT_FILTER_ALWAYS_INLINE void LoadLanes(const UInt128 *fingerprints, U64x8 &lo, U64x8 &hi) {
+            U64x8 a, b;
+            memcpy(&a, fingerprints, sizeof(a));
+            memcpy(&b, fingerprints + 4, sizeof(b));
+            lo = __builtin_shufflevector(a, b, 0, 2, 4, 6, 8, 10, 12, 14);
+            hi = __builtin_shufflevector(a, b, 1, 3, 5, 7, 9, 11, 13, 15);
+        }
+
+        __attribute__((target("avx512f")))
+        FINGERPRINT_FILTER_ALWAYS_INLINE U64x8 Gather(const uint64_t *words, const U64x8 &index) {
+            return (U64x8)_mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xFF, (__m512i)index, words, 8);
+        }
+
+        FINGERPRINT_FILTER_ALWAYS_INLINE void StoreLanes(const U64x8 &found, bool *out) {
+            for (int i = 0; i < 8; i++) {
+                out[i] = found[i] != 0;
+            }
+        }
+
+        __attribute__((target("avx512f")))
+        FINGERPRINT_FILTER_ALWAYS_INLINE void BloomLanes(const uint64_t *words, uint64_t blocks, unsigned k, const UInt128 *fingerprints, size_t n, bool *out) {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                for (size_t j = i + kPrefetchAhead; j < i + kPrefetchAhead + 8 && j < n; j++) {
+                    Prefetch(BlockOf(words, blocks, fingerprints[j]));
+                }
+                U64x8 lo, hi;
+                LoadLanes(fingerprints + i, lo, hi);
+                U64x8 base = (lo & (blocks - 1)) * kBlockWords;
+                U64x8 h1 = hi & 0xFFFFFFFF, h2 = (hi >> 32) | 1, found = base - base + 1;
+                for (unsigned p = 0; p < k; p++) {
+                    U64x8 bit = (h1 + p * h2) & (kBlockBits - 1);
+                    found &= Gather(words, base + (bit >> 6)) >> (bit & 63);
+                }
+                StoreLanes(found, out + i);
+            }
+            BloomScalar(words, blocks, k, fingerprints + i, n - i, out + i);
+        }
+
+        __attribute__((target("avx512f")))
+        FINGERPRINT_FILTER_ALWAYS_INLINE void CuckooLanes(const uint64_t *buckets, uint64_t mask, const UInt128 *fingerprints, size_t n, bool *out) {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                for (size_t j = i + kPrefetchAhead; j < i + kPrefetchAhead + 8 && j < n; j++) {
+                    Prefetch(buckets + (UInt128Low64(fingerprints[j]) & mask));
+                }
+                U64x8 lo, hi;
+                LoadLanes(fingerprints + i, lo, hi);
+                U64x8 tag = hi >> (64 - kTagBits);
+                tag -= (U64x8)(tag == 0);
+                U64x8 first = lo & mask, second = (first ^ (tag * kTagMul)) & mask;
+                U64x8 tags = tag * kTagLsbs;
+                U64x8 x = Gather(buckets, first) ^ tags, y = Gather(buckets, second) ^ tags;
+                StoreLanes(((x - kTagLsbs) & ~x & kTagMsbs) | ((y - kTagLsbs) & ~y & kTagMsbs), out + i);
+            }
+            CuckooScalar(buckets, mask, fingerprints + i, n - i, out + i);
+        }
+
+        __attribute__((target("avx512f")))
+        void BloomAVX512F(const uint64_t *words, uint64_t blocks, unsigned k, const UInt128 *fingerprints, size_t n, bool *out) {
+            BloomLanes(words, blocks, k, fingerprints, n, out);
+        }
+
+        __attribute__((target("avx512f")))
+        void CuckooAVX512F(const uint64_t *buckets, uint64_t mask, const UInt128 *fingerprints, size_t n, bool *out) {
+            CuckooLanes(buckets, mask, fingerprints, n, out);
+        }
+
+        __attribute__((target("avx512f,avx512dq")))
+        void CuckooAVX512DQ(const uint64_t *buckets, uint64_t mask, const UInt128 *fingerprints, size_t n, bool *out) {
+            CuckooLanes(buckets, mask, fingerprints, n, out);
+        }
+
+        #undef FINGERPRINT_FILTER_ALWAYS_INLINE
+
+    #endif
+
+        BloomKernel SelectBloomKernel() {
+        #if defined(FINGERPRINT_FILTER_X86_64)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return BloomAVX512F;
+            }
+        #endif
+            return BloomScalar;
+        }
+
+        CuckooKernel SelectCuckooKernel() {
+        #if defined(FINGERPRINT_FILTER_X86_64)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return __builtin_cpu_supports("avx512dq") ? CuckooAVX512DQ : CuckooAVX512F;
+            }
+        #endif
+            return CuckooScalar;
+        }
+
+    }
+
+    // ---------------------------------------------------------------------
+
+    BlockedBloomFilter::BlockedBloomFilter(size_t expected, unsigned bits_per_fingerprint) : view_(0), blocks_(1) {
+        assert(bits_per_fingerprint > 0);
+        while (blocks_ * kBlockBits < static_cast<uint64_t>(expected) * bits_per_fingerprint) {
+            blocks_ *= 2;
+        }
+        k_ = std::min(kMaxProbes, std::max(1u, static_cast<unsigned>(std::lround(bits_per_fingerprint * std::log(2.0)))));
+        words_.resize(blocks_ * kBlockWords);
+    }
+
+    uint64_t *BlockedBloomFilter::MutableWords() {
+        if (view_) {
+            words_.assign(view_, view_ + blocks_ * kBlockWords);
+            view_ = 0;
+        }
+        return words_.data();
+    }
+
+    void BlockedBloomFilter::Insert(const UInt128 &fingerprint) {
+        uint64_t *block = MutableWords() + (UInt128Low64(fingerprint) & (blocks_ - 1)) * kBlockWords;
+        uint64_t h = UInt128High64(fingerprint), h1 = h & 0xFFFFFFFF, h2 = (h >> 32) | 1;
+        for (unsigned i = 0; i < k_; i++) {
+            uint64_t bit = (h1 + i * h2) & (kBlockBits - 1);
+            block[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+    }
+
+    bool BlockedBloomFilter::Contains(const UInt128 &fingerprint) const {
+        return BlockContains(BlockOf(Words(), blocks_, fingerprint), UInt128High64(fingerprint), k_) != 0;
+    }
+
+    void BlockedBloomFilter::Contains(const UInt128 *fingerprints, size_t n, bool *out) const {
+        static const BloomKernel kernel = SelectBloomKernel();
+        kernel(Words(), blocks_, k_, fingerprints, n, out);
+    }
+
+    size_t BlockedBloomFilter::SerializedSize() const {
+        return kHeaderSize + blocks_ * kBlockWords * sizeof(uint64_t);
+    }
+
+    void BlockedBloomFilter::Serialize(uint8_t *out) const {
+        const uint64_t params[] = { kFingerprintFilterVersion, blocks_, k_ };
+        SerializeFilter(kBloomMagic, params, 3, Words(), blocks_ * kBlockWords, out);
+    }
+
+    bool BlockedBloomFilter::Load(const uint8_t *bytes, size_t size) {
+        uint64_t params[3];
+        if (!LoadHeader(kBloomMagic, bytes, size, params, 3)) {
+            return false;
+        }
+        uint64_t blocks = params[1], k = params[2];
+        if (!IsPowerOfTwo(blocks) || blocks > (size - kHeaderSize) / (kBlockWords * sizeof(uint64_t)) || size != kHeaderSize + blocks * kBlockWords * sizeof(uint64_t) || k < 1 || k > kMaxProbes) {
+            return false;
+        }
+        view_ = LoadWords(bytes, blocks * kBlockWords, words_);
+        blocks_ = blocks;
+        k_ = static_cast<unsigned>(k);
+        return true;
+    }
+
+    // ---------------------------------------------------------------------
+
+    CuckooFilter::CuckooFilter(size_t expected) : view_(0), mask_(1), size_(0), victim_(0), victim_bucket_(0) {
+        while ((mask_ + 1) * kSlots * 95 / 100 < expected) {
+            mask_ = mask_ * 2 + 1;
+        }
+        buckets_.resize(mask_ + 1);
+    }
+
+    uint64_t *CuckooFilter::MutableBuckets() {
+        if (view_) {
+            buckets_.assign(view_, view_ + mask_ + 1);
+            view_ = 0;
+        }
+        return buckets_.data();
+    }
+
+    bool CuckooFilter::Insert(const UInt128 &fingerprint) {
+        if (victim_) {
+            return false;
+        }
+        size_++;
+        Place(MutableBuckets(), TagOf(fingerprint), UInt128Low64(fingerprint) & mask_);
+        return true;
+    }
+
+    // When both buckets are full, a tag is kicked out of one of them to its own
+    // other bucket, and so on.  If that goes on too long, the last tag kicked
+    // out is kept aside as the victim, and the filter takes no more until
+    // something is erased.
+
+    void CuckooFilter::Place(uint64_t *buckets, uint64_t tag, uint64_t bucket) {
+        uint64_t other = OtherBucket(bucket, tag, mask_);
+        if (PutTag(buckets[bucket], tag) || PutTag(buckets[other], tag)) {
+            return;
+        }
+        bucket = tag & 1 ? other : bucket;
+        for (int kick = 0; kick < kMaxKicks; kick++) {
+            uint64_t shift = ((tag + kick) % kSlots) * kTagBits;
+            uint64_t kicked = (buckets[bucket] >> shift) & kTagMask;
+            buckets[bucket] ^= (kicked ^ tag) << shift;
+            tag = kicked;
+            bucket = OtherBucket(bucket, tag, mask_);
+            if (PutTag(buckets[bucket], tag)) {
+                return;
+            }
+        }
+        victim_ = tag;
+        victim_bucket_ = bucket;
+    }
+
+    bool CuckooFilter::Erase(const UInt128 &fingerprint) {
+        uint64_t tag = TagOf(fingerprint), bucket = UInt128Low64(fingerprint) & mask_;
+        uint64_t other = OtherBucket(bucket, tag, mask_);
+        if (victim_ == tag && (victim_bucket_ == bucket || victim_bucket_ == other)) {
+            victim_ = 0;
+            size_--;
+            return true;
+        }
+        uint64_t *buckets = MutableBuckets();
+        if (!RemoveTag(buckets[bucket], tag) && !RemoveTag(buckets[other], tag)) {
+            return false;
+        }
+        size_--;
+        if (victim_) {
+            tag = victim_;
+            victim_ = 0;
+            Place(buckets, tag, victim_bucket_);
+        }
+        return true;
+    }
+
+    bool CuckooFilter::Contains(const UInt128 &fingerprint) const {
+        const uint64_t *buckets = Buckets();
+        uint64_t tag = TagOf(fingerprint), bucket = UInt128Low64(fingerprint) & mask_;
+        uint64_t other = OtherBucket(bucket, tag, mask_);
+        return HasTag(buckets[bucket], tag) || HasTag(buckets[other], tag) || (victim_ == tag && (victim_bucket_ == bucket || victim_bucket_ == other));
+    }
+
+    void CuckooFilter::Contains(const UInt128 *fingerprints, size_t n, bool *out) const {
+        static const CuckooKernel kernel = SelectCuckooKernel();
+        kernel(Buckets(), mask_, fingerprints, n, out);
+        for (size_t i = 0; victim_ && i < n; i++) {
+            out[i] = out[i] || Contains(fingerprints[i]);
+        }
+    }
+
+    size_t CuckooFilter::SerializedSize() const {
+        return kHeaderSize + (mask_ + 1) * sizeof(uint64_t);
+    }
+
+    void CuckooFilter::Serialize(uint8_t *out) const {
+        const uint64_t params[] = { kFingerprintFilterVersion, mask_ + 1, size_, victim_, victim_bucket_ };
+        SerializeFilter(kCuckooMagic, params, 5, Buckets(), mask_ + 1, out);
+    }
+
+    bool CuckooFilter::Load(const uint8_t *bytes, size_t size) {
+        uint64_t params[5];
+        if (!LoadHeader(kCuckooMagic, bytes, size, params, 5)) {
+            return false;
+        }
+        uint64_t buckets = params[1];
+        if (!IsPowerOfTwo(buckets) || buckets < 2 || buckets > (size - kHeaderSize) / sizeof(uint64_t) || size != kHeaderSize + buckets * sizeof(uint64_t) || params[3] > kTagMask || params[4] >= buckets) {
+            return false;
+        }
+        view_ = LoadWords(bytes, buckets, buckets_);
+        mask_ = buckets - 1;
+        size_ = params[2];
+        victim_ = params[3];
+        victim_bucket_ = params[4];
+        return true;
+    }
+
+}
@@ -0,0 +1,135 @@
+// Approximate-membership filters keyed by 128-bit fingerprints.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Both filters take the bits they need straight from a fingerprint instead of
+// hashing it again, may report a fingerprint that was never inserted (a false
+// positive), and never miss one that was.
+//
+// `BlockedBloomFilter` is an array of 64-byte blocks.  The fingerprint's low
+// word picks the block, and its high word the `k` bits within it, by double
+// hashing; a query reads exactly one cache line.  At the default 10 bits per
+// fingerprint (before rounding the block count up to a power of two) it
+// answers wrongly about 1% of the time.
+//
+// `CuckooFilter` keeps a 16-bit tag from the high word in one of two buckets
+// of four, the first picked by the low word and the second by the first and
+// the tag, so it can also erase.  It is sized to run at most 95% full, and
+// answers wrongly about 0.01% of the time.
+//
+// The bulk `Contains()` overloads answer for `n` fingerprints at once, with the
+// memory accesses of different fingerprints overlapped, and (on x86-64 CPUs
+// with AVX-512) eight fingerprints tested per vector.
+//
+// The serialized form is a 64-byte header followed by the table as
+// little-endian 64-bit words.  `Load()` uses the bytes in place when it can
+// (on little-endian platforms, given 8-byte alignment, as from `mmap()`), in
+// which case they must outlive the filter and not change; an insert or erase
+// copies them first.  It returns false if the bytes are not a filter of this
+// kind and version.
+//
+// Neither filter is safe to modify while another thread uses it.
+//
+#ifndef FINGERPRINT_FILTER_HPP
+#define FINGERPRINT_FILTER_HPP
+
+#include "UInt128.hpp"
+
+#include <vector>
+
+namespace FarmHash {
+
+    const uint32_t kFingerprintFilterVersion = 1;
+
+    class BlockedBloomFilter {
+
+    public:
+
+        explicit BlockedBloomFilter(size_t expected = 0, unsigned bits_per_fingerprint = 10);
+
+        void Insert(const UInt128 &fingerprint);
+
+        bool Contains(const UInt128 &fingerprint) const;
+
+        void Contains(const UInt128 *fingerprints, size_t n, bool *out) const;
+
+        size_t SerializedSize() const;
+        void Serialize(uint8_t *out) const;
+        bool Load(const uint8_t *bytes, size_t size);
+
+    private:
+
+        const uint64_t *Words() const { return view_ ? view_ : words_.data(); }
+        uint64_t *MutableWords();
+
+        std::vector<uint64_t> words_;
+        const uint64_t *view_;      // loaded in place, or null
+        uint64_t blocks_;           // a power of two
+        unsigned k_;
+
+    };
+
+    class CuckooFilter {
+
+    public:
+
+        explicit CuckooFilter(size_t expected = 0);
+
+        // Returns false, leaving the filter unchanged, if it is full.  Inserting
+        // the same fingerprint twice stores it twice.
+
+        bool Insert(const UInt128 &fingerprint);
+
+        // Removes one copy of a fingerprint that was inserted; erasing one that
+        // was not may remove another that shares its tag and buckets.
+
+        bool Erase(const UInt128 &fingerprint);
+
+        bool Contains(const UInt128 &fingerprint) const;
+
+        void Contains(const UInt128 *fingerprints, size_t n, bool *out) const;
+
+        size_t Size() const { return size_; }
+
+        size_t SerializedSize() const;
+        void Serialize(uint8_t *out) const;
+        bool Load(const uint8_t *bytes, size_t size);
+
+    private:
+
+        const uint64_t *Buckets() const { return view_ ? view_ : buckets_.data(); }
+        uint64_t *MutableBuckets();
+        void Place(uint64_t *buckets, uint64_t tag, uint64_t bucket);
+
+        std::vector<uint64_t> buckets_;     // four tags each, zero if free
+        const uint64_t *view_;              // loaded in place, or null
+        uint64_t mask_;                     // buckets - 1
+        uint64_t size_;
+        uint64_t victim_;                   // tag evicted when full, or zero
+        uint64_t victim_bucket_;
+
+    };
+
+}
+
+#endif // ! FINGERPRINT_FILTER_HPP
@@ -0,0 +1,598 @@
+// Concurrent sets and maps keyed by 128-bit fingerprints.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// `ConcurrentFingerprintSet` and `ConcurrentFingerprintMap<Value>` are
+// insert-only, open-addressing tables in the style of Abseil's "Swiss tables",
+// shared by any number of threads.  A fingerprint is already uniformly mixed,
+// so it is not hashed again: the top half of its low word picks the first
+// group of eight slots to probe, and seven of its bits are the tag kept in the
+// slot's control byte.  A group's eight control bytes are one 64-bit word,
+// matched a byte at a time in parallel and updated with compare-and-swap.
+//
+// A slot is a 16-byte key and a control byte (plus the value, in a map), so a
+// set takes 17 bytes a slot and nothing more.  A table grows when it is 15/16
+// full: given the expected count, the constructor sizes it to about 18 bytes
+// per fingerprint, and growing by doubling costs up to twice that.
+//
+// No operation waits for another.  `Contains()` and `Find()` read only
+// published slots.  `Insert()` claims an empty slot by swapping its control
+// byte, then fills in each word of the key with a compare-and-swap from zero,
+// and publishes the tag last.  A thread inserting the same key that finds the
+// claim half done finishes it rather than waiting, and a different key passes
+// it by; whoever publishes has inserted the key.  A map cannot finish another
+// thread's value, so there a thread that finds its own key half written spoils
+// that slot and goes on to the next.  When a table fills up, every thread that
+// inserts meanwhile helps copy groups to one twice the size and then carries
+// on in it, and whoever copies the last group of the oldest table makes its
+// successor current.  The old table is freed once no operation can still see
+// it.
+//
+// Nothing is ever erased, and a map's values must be trivially copyable and
+// are never changed after insertion: first writer wins.
+//
+#ifndef FINGERPRINT_SET_HPP
+#define FINGERPRINT_SET_HPP
+
+#include "UInt128.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+namespace FarmHash {
+
+    namespace detail {
+
+        struct NoValue {};
+
+        inline unsigned CountTrailingZeros64(uint64_t x) {
+        #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(x);
+        #elif defined(_MSC_VER) && defined(_M_X64)
+            unsigned long index;
+            _BitScanForward64(&index, x);
+            return index;
+        #else
+            unsigned n = 0;
+            while (!(x & 1)) {
+                x >>= 1;
+                n++;
+            }
+            return n;
+        #endif
+        }
+
+        // The in-flight counter used by this thread (see `FingerprintTable::Enter()`).
+
+        inline size_t FingerprintTableStripe() {
+            static std::atomic<size_t> next(0);
+            thread_local size_t stripe = next++;
+            return stripe;
+        }
+
+        template <typename Value>
+        class FingerprintTable {
+
+        public:
+
+            explicit FingerprintTable(size_t expected) : stripes_(new Stripe[kStripes]()), retired_(0) {
+                current_.store(new Table(std::max<size_t>(2, (expected * 16 / 15 + kGroupSize - 1) / kGroupSize)));
+            }
+
+            ~FingerprintTable() {
+                for (Table *t = current_.load(); t; ) {
+                    Table *next = t->next.load();
+                    delete t;
+                    t = next;
+                }
+                for (Table *t = retired_.load(); t; ) {
+                    Table *older = t->older;
+                    delete t;
+                    t = older;
+                }
+                delete[] stripes_;
+            }
+
+            FingerprintTable(const FingerprintTable &) = delete;
+            FingerprintTable &operator=(const FingerprintTable &) = delete;
+
+            bool Insert(const UInt128 &fingerprint, const Value *value) {
+                Stripe &stripe = Enter();
+                const Key key = Encode(fingerprint);
+                Result r;
+                for (Table *t = current_.load(); ; ) {
+                    size_t probes;
+                    r = TryInsert(t, key, value, probes);
+                    if (r == kOutgrown || r == kFull) {
+                        t = Grow(t);
+                        continue;
+                    }
+                    if (r == kInserted) {
+                        stripe.inserted.fetch_add(1, std::memory_order_relaxed);
+                        if (probes > 0 && Size() > Limit(t)) {
+                            Grow(t);
+                        }
+                    }
+                    break;
+                }
+                Exit(stripe);
+                if (retired_.load(std::memory_order_relaxed)) {
+                    Reclaim();
+                }
+                return r == kInserted;
+            }
+
+            bool Find(const UInt128 &fingerprint, Value *value) const {
+                Stripe &stripe = Enter();
+                const Key key = Encode(fingerprint);
+                Result r = kMissing;
+                for (const Table *t = current_.load(); t; ) {
+                    r = TryFind(t, key, value);
+                    t = r == kOutgrown || r == kFull ? t->next.load(std::memory_order_acquire) : 0;
+                }
+                Exit(stripe);
+                return r == kFound;
+            }
+
+            size_t Size() const {
+                size_t n = 0;
+                for (size_t i = 0; i < kStripes; i++) {
+                    n += stripes_[i].inserted.load(std::memory_order_relaxed);
+                }
+                return n;
+            }
+
+            size_t Capacity() const {
+                Stripe &stripe = Enter();
+                size_t n = current_.load()->groups * kGroupSize;
+                Exit(stripe);
+                return n;
+            }
+
+        private:
+
+            static const bool kHasValue = !std::is_empty<Value>::value;
+
+            static_assert(std::is_trivially_copyable<Value>::value, "map values must be trivially copyable");
+
+            // Control bytes.  Published slots hold a 7-bit tag.  A claimed slot holds
+            // the two key bits its words leave out, and once its table is outgrown
+            // it is frozen; a slot that was empty then is moved.
+
+            static const size_t kGroupSize = 8;
+            static const uint64_t kEmpty = 0x80;
+            static const uint64_t kClaimed = 0xC2;     // | 0x0C: the missing bits
+            static const uint64_t kFrozen = 0xFE;
+            static const uint64_t kMoved = 0xFF;
+            static const uint64_t kLsbs = 0x0101010101010101ULL;
+            static const uint64_t kMsbs = 0x8080808080808080ULL;
+
+            // The high bit of every byte of 'group' equal to 'byte'.
+
+            static uint64_t Match(uint64_t group, uint64_t byte) {
+                uint64_t x = group ^ (kLsbs * byte);
+                return ~(((x & ~kMsbs) + ~kMsbs) | x | ~kMsbs);
+            }
+
+            // Of the control bytes only 'kEmpty' has its top bit set and bit 1 clear.
+
+            static uint64_t MatchEmpty(uint64_t group) {
+                return group & ~(group << 6) & kMsbs;
+            }
+
+            static size_t Slot(uint64_t match) {
+                return CountTrailingZeros64(match) / 8;
+            }
+
+            static uint64_t Byte(uint64_t group, size_t slot) {
+                return (group >> (8 * slot)) & 0xFF;
+            }
+
+            // A key as stored: each word shifted up past a low bit that is always
+            // set, so that zero means "not written yet" and an even word marks a
+            // slot spoiled.  The top bits shifted out are kept in the tag (and in
+            // the claim), which is the top six bits of the high word and the top
+            // bit of the low one.
+
+            struct Key {
+                uint64_t high, low;
+                uint64_t tag, claim;
+                uint64_t spread;                   // picks the first group
+            };
+
+            static const uint64_t kSpoiled = 2;
+
+            static Key Encode(const UInt128 &fingerprint) {
+                uint64_t high = UInt128High64(fingerprint), low = UInt128Low64(fingerprint);
+                Key key = { (high << 1) | 1, (low << 1) | 1, (high >> 58) | ((low >> 63) << 6), kClaimed | ((high >> 63) << 3) | ((low >> 63) << 2), low >> 32 };
+                return key;
+            }
+
+            static UInt128 Decode(uint64_t high, uint64_t low, uint64_t tag) {
+                return UInt128((low >> 1) | ((tag >> 6) << 63), (high >> 1) | (((tag >> 5) & 1) << 63));
+            }
+
+            struct Table {
+
+                explicit Table(size_t groups)
+                    : groups(groups), control(new std::atomic<uint64_t>[groups]), words(new std::atomic<uint64_t>[2 * groups * kGroupSize]),
+                      values(kHasValue ? new Value[groups * kGroupSize] : 0), next(0), claimed(0), migrated(0), older(0)
+                {
+                    for (size_t i = 0; i < groups; i++) {
+                        control[i].store(kEmpty * kLsbs, std::memory_order_relaxed);
+                    }
+                    for (size_t i = 0; i < 2 * groups * kGroupSize; i++) {
+                        words[i].store(0, std::memory_order_relaxed);
+                    }
+                }
+
+                ~Table() {
+                    delete[] control;
+                    delete[] words;
+                    delete[] values;
+                }
+
+                const size_t groups;
+                std::atomic<uint64_t> *control;
+                std::atomic<uint64_t> *words;      // high and low, a pair per slot
+                Value *values;
+                std::atomic<Table *> next;         // the table being migrated to
+                std::atomic<size_t> claimed;       // groups handed out for migration
+                std::atomic<size_t> migrated;      // groups migrated
+                Table *older;                      // once retired
+
+            };
+
+            static size_t Limit(const Table *t) {
+                return t->groups * kGroupSize * 15 / 16;
+            }
+
+            // An operation holds its stripe's count up for as long as it may touch
+            // a table; threads are spread over the stripes to keep them uncontended.
+
+            struct Stripe {
+                std::atomic<size_t> active;
+                std::atomic<size_t> inserted;
+                char padding[128 - 2 * sizeof(std::atomic<size_t>)];
+            };
+
+            static const size_t kStripes = 64;
+
+            Stripe &Enter() const {
+                Stripe &stripe = stripes_[FingerprintTableStripe() % kStripes];
+                stripe.active.fetch_add(1);
+                return stripe;
+            }
+
+            static void Exit(Stripe &stripe) {
+                stripe.active.fetch_sub(1, std::memory_order_release);
+            }
+
+            enum Result { kInserted, kFound, kMissing, kOutgrown, kFull };
+
+            // Groups are probed in order from the one the key picks, which lets a
+            // table have any number of them.
+
+            static size_t First(const Table *t, const Key &key) {
+                return size_t((key.spread * t->groups) >> 32);
+            }
+
+            static bool Holds(const Table *t, size_t i, const Key &key) {
+                return t->words[2 * i].load(std::memory_order_relaxed) == key.high && t->words[2 * i + 1].load(std::memory_order_relaxed) == key.low;
+            }
+
+            // Fill in one word of a claimed slot.  A map's words are only written by
+            // the thread that claimed the slot; anyone else spoils an unwritten word
+            // that might be part of the same key.
+
+            static bool Fill(std::atomic<uint64_t> &word, uint64_t wanted, bool claimer) {
+                uint64_t found = 0;
+                uint64_t written = kHasValue && !claimer ? kSpoiled : wanted;
+                if (word.compare_exchange_strong(found, written)) {
+                    found = written;
+                }
+                return found == wanted;
+            }
+
+            // Put 'key' in 'slot' if it belongs there: kMissing if it does not, and
+            // the next slot should be tried.  Every thread inserting the same key
+            // decides each slot the same way, so they all end up in the same one.
+
+            static Result Place(Table *t, size_t g, size_t slot, const Key &key, const Value *value) {
+                std::atomic<uint64_t> &group = t->control[g];
+                const size_t i = g * kGroupSize + slot;
+                const unsigned shift = unsigned(8 * slot);
+                bool claimer = false;
+                uint64_t control = group.load(std::memory_order_acquire);
+                for (;;) {
+                    uint64_t byte = Byte(control, slot);
+                    if (byte == kMoved) {
+                        return kOutgrown;
+                    }
+                    if (byte == kEmpty) {
+                        if (!group.compare_exchange_weak(control, control ^ ((kEmpty ^ key.claim) << shift), std::memory_order_acquire)) {
+                            continue;
+                        }
+                        claimer = true;
+                    } else if (byte == key.tag) {
+                        return Holds(t, i, key) ? kFound : kMissing;
+                    } else if (byte != key.claim) {
+                        return kMissing;
+                    }
+                    break;
+                }
+                if (kHasValue && claimer && value) {
+                    t->values[i] = *value;
+                }
+                if (!Fill(t->words[2 * i], key.high, claimer) || !Fill(t->words[2 * i + 1], key.low, claimer)) {
+                    return kMissing;
+                }
+                control = group.load(std::memory_order_acquire);
+                for (;;) {
+                    uint64_t byte = Byte(control, slot);
+                    if (byte == key.claim) {
+                        if (group.compare_exchange_weak(control, control ^ ((key.claim ^ key.tag) << shift), std::memory_order_acq_rel)) {
+                            return !kHasValue || claimer ? kInserted : kFound;
+                        }
+                        continue;
+                    }
+                    if (byte == key.tag) {
+                        return kHasValue && claimer ? kInserted : kFound;
+                    }
+                    return kMissing; // frozen before it was published
+                }
+            }
+
+            static Result TryInsert(Table *t, const Key &key, const Value *value, size_t &probes) {
+                size_t g = First(t, key);
+                for (probes = 0; probes < t->groups; probes++) {
+                    uint64_t control = t->control[g].load(std::memory_order_acquire);
+                    for (uint64_t m = Match(control, key.tag); m; m &= m - 1) {
+                        if (Holds(t, g * kGroupSize + Slot(m), key)) {
+                            return kFound;
+                        }
+                    }
+                    for (uint64_t m = MatchEmpty(control) | Match(control, key.claim) | Match(control, kMoved); m; m &= m - 1) {
+                        Result r = Place(t, g, Slot(m), key, value);
+                        if (r != kMissing) {
+                            return r;
+                        }
+                    }
+                    g = g + 1 == t->groups ? 0 : g + 1;
+                }
+                return kFull;
+            }
+
+            static Result TryFind(const Table *t, const Key &key, Value *value) {
+                size_t g = First(t, key);
+                for (size_t probes = 0; probes < t->groups; probes++) {
+                    uint64_t control = t->control[g].load(std::memory_order_acquire);
+                    for (uint64_t m = Match(control, key.tag); m; m &= m - 1) {
+                        size_t i = g * kGroupSize + Slot(m);
+                        if (Holds(t, i, key)) {
+                            if (kHasValue && value) {
+                                *value = t->values[i];
+                            }
+                            return kFound;
+                        }
+                    }
+                    if (Match(control, kMoved)) {
+                        return kOutgrown;
+                    }
+                    if (MatchEmpty(control)) {
+                        return kMissing;
+                    }
+                    g = g + 1 == t->groups ? 0 : g + 1;
+                }
+                return kFull;
+            }
+
+            // The table 't' is being migrated to, allocated by whoever asks first.
+
+            static Table *Successor(Table *t) {
+                Table *next = t->next.load(std::memory_order_acquire);
+                if (!next) {
+                    Table *fresh = new Table(t->groups * 2);
+                    if (t->next.compare_exchange_strong(next, fresh)) {
+                        next = fresh;
+                    } else {
+                        delete fresh;
+                    }
+                }
+                return next;
+            }
+
+            // Freeze a group, so that nothing more can be published there: empty
+            // slots become moved and claimed ones frozen.  Then copy its published
+            // keys across.  A key is always found in the old table or (once it has
+            // been looked for there) a later one, and is never inserted into two.
+            //
+            // Concurrent inserts can fill 'next' before the migration is done; keys
+            // that do not fit go on down the chain, to be moved again when 'next'
+            // is itself replaced.
+
+            static void MigrateGroup(Table *t, Table *next, size_t g) {
+                uint64_t control = t->control[g].load(std::memory_order_acquire), frozen;
+                do {
+                    frozen = control;
+                    for (size_t slot = 0; slot < kGroupSize; slot++) {
+                        uint64_t byte = Byte(control, slot);
+                        if (byte == kEmpty || (byte & 0x80) != 0) {
+                            frozen |= (byte == kEmpty ? kMoved : kFrozen) << (8 * slot);
+                        }
+                    }
+                } while (!t->control[g].compare_exchange_weak(control, frozen, std::memory_order_acq_rel));
+                for (uint64_t m = ~frozen & kMsbs; m; m &= m - 1) {
+                    size_t i = g * kGroupSize + Slot(m), probes;
+                    const Key key = Encode(Decode(t->words[2 * i].load(std::memory_order_relaxed), t->words[2 * i + 1].load(std::memory_order_relaxed), Byte(frozen, Slot(m))));
+                    const Value *value = kHasValue ? &t->values[i] : 0;
+                    for (Table *to = next; ; to = Successor(to)) {
+                        Result r = TryInsert(to, key, value, probes);
+                        if (r == kInserted || r == kFound) {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // Help migrate 't' to 'next' until no groups are left to hand out, and
+            // return 'next' to carry on in.  Whoever migrates the last group moves
+            // 'current_' along.
+
+            Table *Grow(Table *t) {
+                const size_t kBatch = 64;
+                Table *next = Successor(t);
+                for (;;) {
+                    size_t begin = t->claimed.fetch_add(kBatch);
+                    if (begin >= t->groups) {
+                        return next;
+                    }
+                    size_t end = std::min(begin + kBatch, t->groups);
+                    for (size_t g = begin; g < end; g++) {
+                        MigrateGroup(t, next, g);
+                    }
+                    if (t->migrated.fetch_add(end - begin) + (end - begin) == t->groups) {
+                        Advance();
+                        return next;
+                    }
+                }
+            }
+
+            // Make each fully migrated table's successor current, oldest first, and
+            // retire it.  A table can finish before the one that feeds it, so both
+            // finishers try; the compare-and-swap lets only one retire each table.
+
+            void Advance() {
+                for (;;) {
+                    Table *t = current_.load();
+                    Table *next = t->next.load();
+                    if (!next || t->migrated.load() != t->groups) {
+                        return;
+                    }
+                    if (current_.compare_exchange_strong(t, next)) {
+                        Retire(t, t);
+                    }
+                }
+            }
+
+            // Push the retired tables 'first' to 'last' (linked by 'older').
+
+            void Retire(Table *first, Table *last) {
+                Table *older = retired_.load();
+                do {
+                    last->older = older;
+                } while (!retired_.compare_exchange_weak(older, first));
+            }
+
+            // Free retired tables once every stripe has been seen idle since they
+            // were retired.  Operations are short, so this is normally immediate; if
+            // a stripe stays busy, they are left for the next call (or the destructor).
+
+            void Reclaim() {
+                Table *tables = retired_.exchange(0);
+                if (!tables) {
+                    return;
+                }
+                for (size_t i = 0; i < kStripes; i++) {
+                    for (unsigned spins = 0; stripes_[i].active.load() != 0; spins++) {
+                        if (spins == 1000) {
+                            Table *last = tables;
+                            while (last->older) {
+                                last = last->older;
+                            }
+                            Retire(tables, last);
+                            return;
+                        }
+                        std::this_thread::yield();
+                    }
+                }
+                while (tables) {
+                    Table *older = tables->older;
+                    delete tables;
+                    tables = older;
+                }
+            }
+
+            Stripe *stripes_;
+            std::atomic<Table *> current_;
+            std::atomic<Table *> retired_;
+
+        };
+
+    }
+
+    class ConcurrentFingerprintSet {
+
+    public:
+
+        explicit ConcurrentFingerprintSet(size_t expected = 0) : table_(expected) {}
+
+        // Returns false if the fingerprint was already present.
+
+        bool Insert(const UInt128 &fingerprint) { return table_.Insert(fingerprint, 0); }
+
+        bool Contains(const UInt128 &fingerprint) const { return table_.Find(fingerprint, 0); }
+
+        size_t Size() const { return table_.Size(); }
+        size_t Capacity() const { return table_.Capacity(); }
+
+    private:
+
+        detail::FingerprintTable<detail::NoValue> table_;
+
+    };
+
+    template <typename Value>
+    class ConcurrentFingerprintMap {
+
+    public:
+
+        explicit ConcurrentFingerprintMap(size_t expected = 0) : table_(expected) {}
+
+        // Returns false, and leaves the existing value alone, if the fingerprint
+        // was already present.
+
+        bool Insert(const UInt128 &fingerprint, const Value &value) { return table_.Insert(fingerprint, &value); }
+
+        bool Find(const UInt128 &fingerprint, Value &value) const { return table_.Find(fingerprint, &value); }
+
+        bool Contains(const UInt128 &fingerprint) const { return table_.Find(fingerprint, 0); }
+
+        size_t Size() const { return table_.Size(); }
+        size_t Capacity() const { return table_.Capacity(); }
+
+    private:
+
+        detail::FingerprintTable<Value> table_;
+
+    };
+
+}
+
+#endif // ! FINGERPRINT_SET_HPP
@@ -0,0 +1,177 @@
+// A value that carries its own lazily computed `Fingerprint128`.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// `Fingerprinted<T>` holds an immutable string or byte buffer (`std::string`,
+// `std::string_view`, `std::vector<uint8_t>` or anything else with `data()`
+// and `size()` over one-byte elements) together with its `Fingerprint128()`,
+// computed on first use and kept inline.  As a key in the standard containers
+// it is hashed once, however many lookups, rehashes and comparisons follow:
+//
+//     std::unordered_map<FarmHash::Fingerprinted<std::string>, Session> sessions;
+//     FarmHash::Fingerprinted<std::string> key(request.session_id());
+//     auto found = sessions.find(key);
+//
+// `std::hash` is the fingerprint's low word.  `==` compares fingerprints, then
+// contents only if they match; `<` orders by fingerprint, then contents, which
+// is consistent with `==` but not with the contents' own order.
+//
+// Any number of threads may read a shared `Fingerprinted` and compute its
+// fingerprint.  They never wait: each computes it if it is not there yet, and
+// the first to finish publishes it with a compare-and-swap on a state word.
+// Copies and moves carry a published fingerprint along; a moved-from object
+// forgets it.  The value can only be replaced as a whole, by assignment, which
+// must not race with readers.
+//
+#ifndef FINGERPRINTED_HPP
+#define FINGERPRINTED_HPP
+
+#include "FarmHash.hpp"
+
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace FarmHash {
+
+    template <typename T>
+    class Fingerprinted {
+
+    public:
+
+        Fingerprinted() : value_(), state_(kEmpty), low_(0), high_(0) {}
+
+        Fingerprinted(const T &value) : value_(value), state_(kEmpty), low_(0), high_(0) {}
+        Fingerprinted(T &&value) : value_(std::move(value)), state_(kEmpty), low_(0), high_(0) {}
+
+        Fingerprinted(const Fingerprinted &other) : value_(other.value_), state_(kEmpty), low_(0), high_(0) {
+            Adopt(other);
+        }
+
+        Fingerprinted(Fingerprinted &&other) noexcept(std::is_nothrow_move_constructible<T>::value) : value_(std::move(other.value_)), state_(kEmpty), low_(0), high_(0) {
+            Adopt(other);
+            other.state_.store(kEmpty, std::memory_order_relaxed);
+        }
+
+        Fingerprinted &operator=(const Fingerprinted &other) {
+            if (this != &other) {
+                value_ = other.value_;
+                state_.store(kEmpty, std::memory_order_relaxed);
+                Adopt(other);
+            }
+            return *this;
+        }
+
+        Fingerprinted &operator=(Fingerprinted &&other) noexcept(std::is_nothrow_move_assignable<T>::value) {
+            if (this != &other) {
+                value_ = std::move(other.value_);
+                state_.store(kEmpty, std::memory_order_relaxed);
+                Adopt(other);
+                other.state_.store(kEmpty, std::memory_order_relaxed);
+            }
+            return *this;
+        }
+
+        Fingerprinted &operator=(const T &value) {
+            value_ = value;
+            state_.store(kEmpty, std::memory_order_relaxed);
+            return *this;
+        }
+
+        Fingerprinted &operator=(T &&value) {
+            value_ = std::move(value);
+            state_.store(kEmpty, std::memory_order_relaxed);
+            return *this;
+        }
+
+        const T &Value() const { return value_; }
+        const T &operator*() const { return value_; }
+        const T *operator->() const { return &value_; }
+
+        UInt128 Fingerprint() const {
+            if (state_.load(std::memory_order_acquire) == kReady) {
+                return UInt128(low_, high_);
+            }
+            UInt128 fingerprint = Fingerprint128(reinterpret_cast<const uint8_t *>(value_.data()), value_.size());
+            uint32_t expected = kEmpty;
+            if (state_.compare_exchange_strong(expected, kWriting, std::memory_order_acquire)) {
+                low_ = UInt128Low64(fingerprint);
+                high_ = UInt128High64(fingerprint);
+                state_.store(kReady, std::memory_order_release);
+            }
+            return fingerprint;
+        }
+
+        bool HasFingerprint() const { return state_.load(std::memory_order_acquire) == kReady; }
+
+        friend bool operator==(const Fingerprinted &a, const Fingerprinted &b) {
+            return &a == &b || (a.Fingerprint() == b.Fingerprint() && a.value_ == b.value_);
+        }
+
+        friend bool operator!=(const Fingerprinted &a, const Fingerprinted &b) { return !(a == b); }
+
+        friend bool operator<(const Fingerprinted &a, const Fingerprinted &b) {
+            UInt128 x = a.Fingerprint(), y = b.Fingerprint();
+            return x != y ? x < y : a.value_ < b.value_;
+        }
+
+        friend bool operator> (const Fingerprinted &a, const Fingerprinted &b) { return b < a;    }
+        friend bool operator<=(const Fingerprinted &a, const Fingerprinted &b) { return !(b < a); }
+        friend bool operator>=(const Fingerprinted &a, const Fingerprinted &b) { return !(a < b); }
+
+    private:
+
+        static_assert(sizeof(*std::declval<T>().data()) == 1, "elements of 'T' must have a size equal to one");
+
+        enum : uint32_t { kEmpty, kWriting, kReady };
+
+        // Take over the fingerprint of 'other' if it has one; called before
+        // 'this' can be seen by any other thread.
+
+        void Adopt(const Fingerprinted &other) {
+            if (other.state_.load(std::memory_order_acquire) == kReady) {
+                low_ = other.low_;
+                high_ = other.high_;
+                state_.store(kReady, std::memory_order_relaxed);
+            }
+        }
+
+        T value_;
+        mutable std::atomic<uint32_t> state_;
+        mutable uint64_t low_, high_;
+
+    };
+
+}
+
+namespace std {
+
+    template <typename T>
+    struct hash<FarmHash::Fingerprinted<T> > {
+        size_t operator()(const FarmHash::Fingerprinted<T> &x) const { return static_cast<size_t>(UInt128Low64(x.Fingerprint())); }
+    };
+
+}
+
+#endif // ! FINGERPRINTED_HPP
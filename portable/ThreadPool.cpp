@@ -0,0 +1,209 @@
+// A small work-stealing thread pool for the parallel `FarmHash` front ends.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+#include "ThreadPool.hpp"
+
+#include <cassert>
+
+// ---------------------------------------------------------------------
+
+namespace FarmHash {
+
+    namespace {
+
+        // Which pool (if any) the current thread works for, and its queue there.
+
+        thread_local const ThreadPool *current_pool = 0;
+        thread_local size_t current_index = 0;
+
+        const size_t kNotAWorker = static_cast<size_t>(-1);
+
+    }
+
+    ThreadPool::ThreadPool(unsigned threads) : next_(0), outstanding_(0), stopping_(false) {
+        if (threads == 0) {
+            unsigned hardware = std::thread::hardware_concurrency();
+            threads = hardware > 1 ? hardware - 1 : 1;
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            queues_.push_back(std::unique_ptr<Queue>(new Queue));
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            workers_.push_back(std::thread(&ThreadPool::Work, this, i));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (size_t i = 0; i < workers_.size(); i++) {
+            workers_[i].join();
+        }
+    }
+
+    void ThreadPool::Submit(std::function<void()> task) {
+        size_t target = current_pool == this ? current_index : next_++ % queues_.size();
+        outstanding_++;
+        {
+            std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+            queues_[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        wake_.notify_one();
+        idle_.notify_all();
+    }
+
+    // Run one task, preferring the newest from our own queue and otherwise the
+    // oldest from somebody else's.
+
+    bool ThreadPool::TryRun(size_t self) {
+        std::function<void()> task;
+        size_t n = queues_.size();
+        if (self != kNotAWorker) {
+            Queue &own = *queues_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        for (size_t k = 0; !task && k < n; k++) {
+            size_t i = self == kNotAWorker ? k : (self + 1 + k) % n;
+            if (i == self) {
+                continue;
+            }
+            Queue &victim = *queues_[i];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (!task) {
+            return false;
+        }
+        task();
+        if (--outstanding_ == 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_.notify_all();
+            if (stopping_) {
+                wake_.notify_all();     // workers that saw this task outstanding may now exit
+            }
+        }
+        return true;
+    }
+
+    // Called with 'mutex_' held before going to sleep.  Submit() queues its task
+    // before taking 'mutex_' to notify, so a task queued between a failed
+    // TryRun() and the sleep is seen here rather than missed.
+
+    bool ThreadPool::HasQueued() {
+        for (size_t i = 0; i < queues_.size(); i++) {
+            std::lock_guard<std::mutex> lock(queues_[i]->mutex);
+            if (!queues_[i]->tasks.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::Work(size_t self) {
+        current_pool = this;
+        current_index = self;
+        for (;;) {
+            if (TryRun(self)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stopping_ && outstanding_ == 0) {
+                return;
+            }
+            if (!HasQueued()) {
+                wake_.wait(lock);
+            }
+        }
+    }
+
+    void ThreadPool::Wait() {
+        assert(current_pool != this && "use ParallelFor() to wait from inside a task");
+        while (outstanding_ > 0) {
+            if (TryRun(kNotAWorker)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (outstanding_ > 0 && !HasQueued()) {
+                idle_.wait(lock);
+            }
+        }
+    }
+
+    // Split off the upper half of the range until what is left is small enough
+    // to do ourselves.  The shared state outlives every task that refers to it.
+
+    void ThreadPool::Range(const std::shared_ptr<ForState> &state, size_t begin, size_t end) {
+        while (end - begin > state->grain) {
+            size_t middle = begin + (end - begin) / 2;
+            std::shared_ptr<ForState> shared = state;
+            Submit([this, shared, middle, end]() { Range(shared, middle, end); });
+            end = middle;
+        }
+        (*state->body)(begin, end);
+        if (state->remaining.fetch_sub(end - begin) == end - begin) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_.notify_all();
+        }
+    }
+
+    void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body) {
+
+        if (begin >= end) {
+            return;
+        }
+
+        std::shared_ptr<ForState> state = std::make_shared<ForState>();
+        state->remaining = end - begin;
+        state->grain = grain > 0 ? grain : 1;
+        state->body = &body;
+
+        Range(state, begin, end);
+
+        size_t self = current_pool == this ? current_index : kNotAWorker;
+        while (state->remaining > 0) {
+            if (TryRun(self)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (state->remaining > 0 && !HasQueued()) {
+                idle_.wait(lock);
+            }
+        }
+
+    }
+
+}
@@ -0,0 +1,104 @@
+// A small work-stealing thread pool for the parallel `FarmHash` front ends.
+//
+// Copyright (c) 2015 Andrew Fernandes <andrew@fernandes.org>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------
+//
+// Every worker owns a deque of tasks.  Tasks submitted from a worker go on the
+// back of its own deque and are popped from there (newest first, which keeps
+// recursively split work cache-local); an idle worker steals from the front
+// of the others' deques (oldest, hence usually largest, first).  Tasks
+// submitted from outside the pool are dealt round-robin.
+//
+// `Wait()` blocks until every task submitted so far has finished, and runs
+// tasks itself while it waits, so a pool of `n` threads plus the waiting
+// caller keeps `n + 1` cores busy.  Tasks must not throw.
+//
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FarmHash {
+
+    class ThreadPool {
+
+    public:
+
+        // With `threads == 0`, one worker per hardware thread (less one for the
+        // caller of `Wait()`, but at least one).
+
+        explicit ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+
+        unsigned Size() const { return static_cast<unsigned>(workers_.size()); }
+
+        void Submit(std::function<void()> task);
+
+        // Call `body(i, j)` over disjoint subranges covering `[begin, end)`, each
+        // at most `grain` long, split recursively so that idle workers can steal
+        // half of whatever is left.  Returns when the whole range is done.
+
+        void ParallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+        void Wait();
+
+    private:
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::function<void()> > tasks;
+        };
+
+        struct ForState {
+            std::atomic<size_t> remaining;
+            size_t grain;
+            const std::function<void(size_t, size_t)> *body;
+        };
+
+        bool TryRun(size_t self);
+        bool HasQueued();
+        void Work(size_t self);
+        void Range(const std::shared_ptr<ForState> &state, size_t begin, size_t end);
+
+        std::vector<std::unique_ptr<Queue> > queues_;
+        std::vector<std::thread> workers_;
+        std::atomic<size_t> next_;          // round-robin target for external submissions
+        std::atomic<size_t> outstanding_;   // submitted but not yet finished
+        std::mutex mutex_;
+        std::condition_variable wake_;      // work was submitted, or we are stopping
+        std::condition_variable idle_;      // a task was submitted, or something being waited for finished
+        bool stopping_;
+
+    };
+
+}
+
+#endif // ! THREAD_POOL_HPP
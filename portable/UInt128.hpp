@@ -4,23 +4,156 @@
 // ---------------------------------------------------------------------
 // Standard header files.
 
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 
-#include <utility>
+#include <functional>
+#include <string>
+
+#if defined(__cpp_impl_three_way_comparison) && defined(__cpp_lib_three_way_comparison)
+#   include <compare>
+#endif
+
+// ---------------------------------------------------------------------
+// Native 128-bit integers, where the compiler has them.
+
+#if defined(__SIZEOF_INT128__)
+#   define UINT128_HAS_NATIVE 1
+#else
+#   define UINT128_HAS_NATIVE 0
+#endif
 
 // ---------------------------------------------------------------------
 #if !defined(UInt128)
 
-typedef std::pair<uint64_t,uint64_t> UInt128;
+// A 128-bit value as two 64-bit halves, 'first' being the low one (so code
+// written for the old 'std::pair<uint64_t,uint64_t>' still compiles).  It is
+// trivially copyable and 16-byte aligned, so the compiler moves and compares
+// it as one 128-bit quantity; where there is an 'unsigned __int128' the
+// ordering is done on that.  Values are ordered numerically (high half first).
+
+struct alignas(16) UInt128 {
+
+    uint64_t first;
+    uint64_t second;
+
+    constexpr UInt128() : first(0), second(0) {}
+    constexpr UInt128(uint64_t lo, uint64_t hi) : first(lo), second(hi) {}
+
+#if UINT128_HAS_NATIVE
+    explicit constexpr UInt128(unsigned __int128 x) : first(static_cast<uint64_t>(x)), second(static_cast<uint64_t>(x >> 64)) {}
+    explicit constexpr operator unsigned __int128() const { return static_cast<unsigned __int128>(second) << 64 | first; }
+#endif
+
+};
+
+constexpr UInt128 AsUInt128(uint64_t lo, uint64_t hi) { return UInt128(lo, hi); }
+
+constexpr uint64_t UInt128Low64 (const UInt128 &x) { return x.first;  }
+constexpr uint64_t UInt128High64(const UInt128 &x) { return x.second; }
+
+constexpr bool operator==(const UInt128 &a, const UInt128 &b) { return ((a.first ^ b.first) | (a.second ^ b.second)) == 0; }
+
+#if defined(__cpp_impl_three_way_comparison) && defined(__cpp_lib_three_way_comparison)
+
+constexpr std::strong_ordering operator<=>(const UInt128 &a, const UInt128 &b) {
+    return a.second != b.second ? a.second <=> b.second : a.first <=> b.first;
+}
+
+#else
+
+#if UINT128_HAS_NATIVE
+constexpr bool operator< (const UInt128 &a, const UInt128 &b) { return static_cast<unsigned __int128>(a) < static_cast<unsigned __int128>(b); }
+#else
+constexpr bool operator< (const UInt128 &a, const UInt128 &b) { return a.second < b.second || (a.second == b.second && a.first < b.first); }
+#endif
 
-inline UInt128 AsUInt128(uint64_t lo, uint64_t hi) { return UInt128(lo, hi); }
+constexpr bool operator!=(const UInt128 &a, const UInt128 &b) { return !(a == b); }
+constexpr bool operator> (const UInt128 &a, const UInt128 &b) { return b < a;    }
+constexpr bool operator<=(const UInt128 &a, const UInt128 &b) { return !(b < a); }
+constexpr bool operator>=(const UInt128 &a, const UInt128 &b) { return !(a < b); }
 
-inline uint64_t UInt128Low64 (const UInt128 &x) { return x.first;  }
-inline uint64_t UInt128High64(const UInt128 &x) { return x.second; }
+#endif
 
 static_assert( sizeof(UInt128) == 16, "the 'UInt128' type must be packed for compatibility with the 'uint8_t[16]' type" );
 
+// ---------------------------------------------------------------------
+// Serialization.
+//
+// The binary form is 16 bytes, little-endian (low half first) on every
+// platform.  The hex form is 32 lower-case digits, most significant first,
+// so that it reads as the number.
+
+inline void UInt128ToBytes(const UInt128 &x, uint8_t *bytes) {
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = static_cast<uint8_t>(x.first >> (8 * i));
+        bytes[i + 8] = static_cast<uint8_t>(x.second >> (8 * i));
+    }
+}
+
+inline UInt128 UInt128FromBytes(const uint8_t *bytes) {
+    uint64_t lo = 0, hi = 0;
+    for (int i = 0; i < 8; i++) {
+        lo |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+        hi |= static_cast<uint64_t>(bytes[i + 8]) << (8 * i);
+    }
+    return UInt128(lo, hi);
+}
+
+// Writes exactly 32 characters, without a terminating null.
+
+inline void UInt128ToHex(const UInt128 &x, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 16; i++) {
+        hex[15 - i] = digits[(x.second >> (4 * i)) & 15];
+        hex[31 - i] = digits[(x.first >> (4 * i)) & 15];
+    }
+}
+
+inline std::string UInt128ToHex(const UInt128 &x) {
+    char hex[32];
+    UInt128ToHex(x, hex);
+    return std::string(hex, 32);
+}
+
+// Accepts exactly 32 hex digits, in either case; returns false otherwise.
+
+inline bool UInt128FromHex(const char *hex, size_t length, UInt128 &x) {
+    if (length != 32) {
+        return false;
+    }
+    uint64_t half[2] = { 0, 0 };
+    for (size_t i = 0; i < 32; i++) {
+        unsigned c = static_cast<unsigned char>(hex[i]), d;
+        if (c - '0' < 10) {
+            d = c - '0';
+        } else if ((c | 0x20) - 'a' < 6) {
+            d = (c | 0x20) - 'a' + 10;
+        } else {
+            return false;
+        }
+        half[i / 16] = half[i / 16] << 4 | d;
+    }
+    x = UInt128(half[1], half[0]);
+    return true;
+}
+
+inline bool UInt128FromHex(const std::string &hex, UInt128 &x) { return UInt128FromHex(hex.data(), hex.length(), x); }
+
+// ---------------------------------------------------------------------
+// Hashing.  A fingerprint is already uniformly mixed, so its low bits are
+// used as they are.
+
+namespace std {
+
+    template <>
+    struct hash<UInt128> {
+        size_t operator()(const UInt128 &x) const noexcept { return static_cast<size_t>(x.first); }
+    };
+
+}
+
 #endif // defined(UInt128)
 // ---------------------------------------------------------------------
 // Done.
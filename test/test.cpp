@@ -1,12 +1,62 @@
 #include "farmhash.h"
 #include "FarmHash.hpp"
+#include "FarmHashStream.hpp"
+#include "FarmHashChunker.hpp"
+#include "FarmHashConstexpr.hpp"
+#include "FarmHashFile.hpp"
+#include "FingerprintCache.hpp"
+#include "FarmHashFixed.hpp"
+#include "FarmHashGather.hpp"
+#include "FarmHashMerkle.hpp"
+#include "FarmHashTree.hpp"
+#include "FingerprintSet.hpp"
+#include "FingerprintFilter.hpp"
+#include "FingerprintDedup.hpp"
+#include "Fingerprinted.hpp"
+#include "FarmHashStats.hpp"
 
 #include <vector>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 using namespace std;
 
+template <size_t N>
+static bool FixedMatches(const char *s)
+{
+    return FarmHash::Fingerprint128<N>((const uint8_t *)s) == FarmHash::Fingerprint128((const uint8_t *)s, N);
+}
+
+// A new temporary file holding 'bytes', or "" if it cannot be written.
+
+static string TemporaryFile(const uint8_t *bytes, size_t length)
+{
+    char name[] = "/tmp/farmhash-test-XXXXXX";
+    int fd = mkstemp(name);
+    if ( fd < 0 ) {
+        return "";
+    }
+    for (size_t done = 0; done < length; ) {
+        ssize_t n = write(fd, bytes + done, length - done);
+        if ( n <= 0 ) {
+            close(fd);
+            unlink(name);
+            return "";
+        }
+        done += n;
+    }
+    close(fd);
+    return name;
+}
+
 int main(int argc, char const *argv[])
 {
 
@@ -17,6 +67,8 @@ int main(int argc, char const *argv[])
     test.push_back("GhJc/MysJ28hjZuTroc8N2h7F5B5fT4VxTcnD0l4Lnjp+4WrtkkmUK/3wYA9TT30eZHvzw+G4lzosD5ZyAtI4gdgiYauWUul4APfxbZFH4TJ9QXmxuq4+xDtkxX37/HkvRgnV92yI2bDDRgZGjH5sdB+Bv4nhMYJ8757A7YSQ6seKeh9PUHJabPLm/5ZSy15dDi+qqhzCzmbozUL1Q/FNDRBM0qhrhJil0GgIxBT7gjp7jiAQeTVUQhAa0fYs7SvMYCsV88WjGD7JNqXOq6cpfB/i57YlIiscdhuQYDGn+wE3qEEORCAa4fieCGhOWENs9AMxgRupRddOwwQt3472NgLiTad3zO+hwKegn1s6gMaxeEautr+0PrRiZWpTEFYwbc9+yDyCK1kHAzATdGXjMtZtz8jKuOpeNn60//S4Wk6Z/Fde0OkGpmxHOIBBtAzJnjEko65J1w83pet52yP4GMLz9RrBg61LICoO+mlsezOYfQS4y3G4QhXXwV/1j0TaJxAX08bVud294Dqzpkq1g87+domPBZd5nNEozph09ZCn6Nifvs5KBWc5Y5RYN9ZG38DHJmRQ/jzP1tCH2CF7Gd5Lod/9/z/dpANRc0Djm5vJxWYarW4wCS+gOcuCqOuhmXZDbPli7gqiZHKJpP13FdBOJJtpZUfB3vk63Wk+AFnPO35NG8TuV731Qe0kgrY7GvhxIJKdbYaO3Yf6zkzRYGu7dzYi5Ae6FGUIFBRhmZshBhh+hRe7cp17E5icjNpRukveni8J+mji2fS5ZeHhCeizG7LOcJyTE2CvLr7+wc6bW47q1/Fh/Z5Ai892OSvS2g1aoXAAkHMQVI9WIobSAwyPlyCIs2nn4MkWqIsvuCplaqTbiMfWR/Cq5oeFllW7UTVIBWSIpIwzoPeCIfQc+bU7NimZxrjK53GETCG7H35bXffukaOiehf7sUHdDRqlQaDPBj0ZY/7jFY4lNJoT8D0Erl/hwfs5W6NvKISmwfY1vT3zxn/GfQcOvCYIpoYDc+kYYAR6MwCR9YRarP4GYPj23+WOnDlzjkdRL5E+IRGT3iGzVYTQLQkxWTqroKX2L+TKjlGLicQ4kdI3RCMku5yCETCmWTmgCM/bOvIi0iBB21o2NESmJvfNqz0qSJd1+sEZww6Cl1eDQWpUTWdh2mcA8EIP5lcmhgwAZJFVj43+eaktAIuFSzPOBs0+NGgjcvWAjXyA61gklbhd/RXhNrdw7XPus4xKwBFrLvSaQxJ+FSsVDjolxR32cs/xbYahoZdx8wwjKDX0Duh3uyd9VlddiofnZw+Z/3nSCRJSCWlkhtjTOROt1RXu/0mj7v7Cdj0ij+J6ISqi9CVMeps1w==");
     test.push_back("c/e2WfRQuC0a5bMHRkBrIzpZJQBgo+Hi2XNGKn95kWDUOexBwqGweXEizSaTQ77RzO2YdhPTBsEB2Brr+bUIvFAoLW7eMQ83zEI9Ouz9KCUHNIM3jNOf84wF8Vb/JcuQqaLTfIOUPzlvtswyCMs2NhAM0tlqcem88YLxtYU3NnOgpQ/o20N1zttPHhH/JL6NzeVYokiM9mzW7VAMTmjmk+GOqtIYBcOO9NBv9o5k8jnYahc22zW+DfJ9tm1Ls/S74GRAjHDtT4nTjh78/nnRvWwdQnxfWkgSgEQQ9t0lOdxBsMVYpacT4OAQKMK/hs7hpzCozypkvqdRJmdwiwZSgVOIvbtWvXfKq8AXeHP+9jbLSjoQkDv8gb72koHqaCJXNgy5DUmbci1b2Z7Xl4gfs0v8zpgWp8751fX7y2CpO29mG0WsghmJQn6LhTvld66y8Z1kn5DjheqvwGhTaivZsWGv0WxsD3mjkCYDw+vWaL0SjhihqjKJPw1xNz+eIR8aj+3Cqu+ML28vrPx4yGd4lZ4gnFW80otD8hkTnawbsKc4aL/uCoW01x8XA1z/8HKuNiq10bRVh3LR5aoSHE7W5Ofobd3VZ2evgUdymyU/BSFRLZ0xcopU4i12Zl8mbVR3+VFta4sSfxMr+fH498bdtpBWlrKfUDQwds8Up+aQl4UisU9/ppGHyksS+P83eBc79M7VRjGo8pwZvGoJWkcFIfpkGhhpyt0mtPrbXAqO5AAqpOCvupjeMICI71GVkEkGzgD1fq1DL/2YOeDT0l233FbzmCJfWVEgoEfi2cRQAYtJcaAJYxph/4aF3L81KmARjbweckHkEg0IjOzzwYw/lgaOOJTe2uqKpF4Bab0Fhrqwg4nhMGgE0TJuUJZE+0BUPVfqHmQr8zMso9we9FkI8RAK9nDogY1iJktjPo8qJsOu9phEngiZsEOGmdc/O+gAA4HXs3+0rcpV/8Yr9PSIZEBPIsKykIlrDX0vmuRZmr24oquFTGEuXT0jUwI0uN2uUv4n61axlJKk4I0lmN0n6NsgGi8Zn1rK5kh6XNZkLQ0GUlIyYTLEchRsSQ8NXwjnM4TS5fnXPMvxuyhrT2EX9/c3zSh6laCs44ntXwzcE/5TPWKUjlHbOJM/ggJbiAI3m6k9S4JWnymE5K7r+Vx9ZefSswp9n5p7EtRURKxQ4fxjWUICDt3BLkPXy1bHH3i1B6y3ECTLDCP2j/SpN7PRIO4Pn8Win/M4/T0rHHk76//llgzewuiUGI4VtLeZu8teXjcVLeG3rYLnGv7lezQJv79jZZnJkv2wVcv9Ppm7WdiuOI+ms/DbuT+j1Fvk8qyf1oQQIBLrteOvt7HJsGeRuA==");
 
+    FarmHash::ConcurrentFingerprintSet seen; // grows several times; only the empty prefix repeats
+
     for (int i = 0; i < test.size(); i++) {
 
         unsigned k = strlen(test[i]);
@@ -30,11 +82,582 @@ int main(int argc, char const *argv[])
                 return -1;
             }
 
+            FarmHash::Fingerprint128Stream stream(j);
+            for ( int c = 0; c < j; c += 1 + c % 61 ) {
+                stream.Update((uint8_t *)test[i] + c, min(1 + c % 61, j - c));
+            }
+
+            if ( stream.Final() != p ) {
+                cerr << "error: streamed hashes are not equal" << endl;
+                return -1;
+            }
+
+            stream.Update((uint8_t *)test[i], 1);
+            if ( stream.Complete() || stream.Final() != UInt128(0, 0) ) {
+                cerr << "error: overrun stream is not failed" << endl;
+                return -1;
+            }
+
+            uint8_t bytes[16];
+            UInt128 q;
+            FarmHash::Fingerprint128((uint8_t *)test[i], j, bytes);
+            if ( UInt128FromBytes(bytes) != p || !UInt128FromHex(UInt128ToHex(p), q) || q != p ) {
+                cerr << "error: serialized hashes are not equal" << endl;
+                return -1;
+            }
+
+            if ( seen.Insert(p) == (i > 0 && j == 0) || seen.Insert(p) || !seen.Contains(p) ) {
+                cerr << "error: fingerprint set is inconsistent" << endl;
+                return -1;
+            }
+
             cout << p.first << '|' << p.second << endl;
 
         }
 
+        vector<const uint8_t *> inputs(k);
+        vector<size_t> lengths(k);
+        vector<UInt128> batch(k);
+        for ( size_t j = 0; j < k; j++ ) {
+            inputs[j] = (uint8_t *)test[i] + (j % 16);
+            lengths[j] = k - (j % 16) - (j % 97);
+        }
+
+        FarmHash::Fingerprint128Batch(inputs.data(), lengths.data(), batch.data(), k);
+
+        for ( size_t j = 0; j < k; j++ ) {
+            if ( batch[j] != FarmHash::Fingerprint128(inputs[j], lengths[j]) ) {
+                cerr << "error: batch hashes are not equal" << endl;
+                return -1;
+            }
+        }
+
+        const UInt128 seeds[3] = { UInt128(0, 0), UInt128(k, i), UInt128(~uint64_t(0), k * 1000003) };
+        for ( size_t length = 0; length <= k; length += 1 + length * 3 ) {
+            UInt128 seeded[3];
+            FarmHash::Fingerprint128MultiSeed((uint8_t *)test[i], length, seeds, 3, seeded);
+            for ( int j = 0; j < 3; j++ ) {
+                if ( seeded[j] != FarmHash::CityHash128WithSeed((uint8_t *)test[i], length, seeds[j]) ) {
+                    cerr << "error: multi-seed hashes are not equal" << endl;
+                    return -1;
+                }
+            }
+        }
+
+    }
+
+    // Chunk all the strings together, whole and streamed in uneven pieces.
+
+    string all;
+    for (size_t i = 0; i < test.size(); i++) {
+        all += test[i];
+    }
+
+    FarmHash::ChunkSizes sizes(64, 256, 1024);
+    vector<FarmHash::Chunk> whole, streamed;
+    FarmHash::FingerprintChunks((uint8_t *)all.data(), all.size(), whole, sizes, 2);
+    FarmHash::Chunker chunker(sizes, 2);
+    for (size_t c = 0; c < all.size(); c += 1 + c % 1999) {
+        chunker.Update((uint8_t *)all.data() + c, min(1 + c % 1999, all.size() - c), streamed);
+    }
+    chunker.Final(streamed);
+
+    uint64_t offset = 0;
+    for (size_t c = 0; c < whole.size(); c++) {
+        if ( c >= streamed.size() || whole[c].offset != offset || whole[c].length != streamed[c].length || whole[c].fingerprint != streamed[c].fingerprint || whole[c].fingerprint != FarmHash::Fingerprint128((uint8_t *)all.data() + offset, whole[c].length) ) {
+            cerr << "error: chunk hashes are not equal" << endl;
+            return -1;
+        }
+        offset += whole[c].length;
+    }
+    if ( offset != all.size() || streamed.size() != whole.size() ) {
+        cerr << "error: chunks do not cover the input" << endl;
+        return -1;
+    }
+
+    // Sizes out of order are put in order, not trusted.
+
+    vector<FarmHash::Chunk> disordered, ordered;
+    FarmHash::FingerprintChunks((uint8_t *)all.data(), all.size(), disordered, FarmHash::ChunkSizes(0, 300, 100), 2);
+    FarmHash::FingerprintChunks((uint8_t *)all.data(), all.size(), ordered, FarmHash::ChunkSizes(64, 300, 300), 2);
+    bool same_chunks = disordered.size() == ordered.size();
+    for (size_t c = 0; same_chunks && c < ordered.size(); c++) {
+        same_chunks = disordered[c].length == ordered[c].length && disordered[c].fingerprint == ordered[c].fingerprint && ordered[c].length >= (c + 1 < ordered.size() ? 64 : 1) && ordered[c].length <= 300;
+    }
+    if ( !same_chunks ) {
+        cerr << "error: chunk sizes are not put in order" << endl;
+        return -1;
+    }
+
+    // Cut the same strings into a column of rows from 0 to 200 bytes long.
+
+    vector<uint32_t> offsets32(1, 0);
+    while ( offsets32.back() + 200 <= all.size() && offsets32.size() < 4096 ) {
+        offsets32.push_back(offsets32.back() + (offsets32.size() * 7) % 201);
+    }
+    vector<uint64_t> offsets64(offsets32.begin(), offsets32.end());
+    size_t rows = offsets32.size() - 1;
+    vector<UInt128> column32(rows), column64(rows);
+    FarmHash::Fingerprint128Column((uint8_t *)all.data(), offsets32.data(), rows, column32.data());
+    FarmHash::Fingerprint128Column((uint8_t *)all.data(), offsets64.data(), rows, column64.data());
+    for (size_t r = 0; r < rows; r++) {
+        UInt128 expected = FarmHash::Fingerprint128((uint8_t *)all.data() + offsets32[r], offsets32[r + 1] - offsets32[r]);
+        if ( column32[r] != expected || column64[r] != expected ) {
+            cerr << "error: column hashes are not equal" << endl;
+            return -1;
+        }
+    }
+
+    // Gather runs of the column's rows, empty ones included, as one input each.
+
+    vector<struct iovec> segments(rows);
+    for (size_t r = 0; r < rows; r++) {
+        segments[r].iov_base = (void *)(all.data() + offsets32[r]);
+        segments[r].iov_len = offsets32[r + 1] - offsets32[r];
+    }
+    for (size_t r = 0, n = 1; r + n <= rows; r += n, n = 1 + r % 13) {
+        if ( FarmHash::Fingerprint128(&segments[r], n) != FarmHash::Fingerprint128((uint8_t *)all.data() + offsets32[r], offsets32[r + n] - offsets32[r]) ) {
+            cerr << "error: gathered hashes are not equal" << endl;
+            return -1;
+        }
+    }
+
+#if defined(__cpp_lib_span)
+    vector<std::span<const uint8_t> > spans(rows);
+    for (size_t r = 0; r < rows; r++) {
+        spans[r] = std::span<const uint8_t>((uint8_t *)all.data() + offsets32[r], offsets32[r + 1] - offsets32[r]);
+    }
+    for (size_t r = 0, n = 1; r + n <= rows; r += n, n = 1 + r % 13) {
+        if ( FarmHash::Fingerprint128(std::span<const std::span<const uint8_t> >(&spans[r], n)) != FarmHash::Fingerprint128(&segments[r], n) ) {
+            cerr << "error: gathered spans are not equal" << endl;
+            return -1;
+        }
+    }
+#endif
+
+    // Filter the first half of the column's fingerprints: no false negatives,
+    // bulk queries agree with single ones, and serialized filters load back.
+
+    size_t half = rows / 2;
+    FarmHash::BlockedBloomFilter bloom(half);
+    FarmHash::CuckooFilter cuckoo(half);
+    for (size_t r = 0; r < half; r++) {
+        bloom.Insert(column32[r]);
+        if ( !cuckoo.Insert(column32[r]) ) {
+            cerr << "error: cuckoo filter is full" << endl;
+            return -1;
+        }
+    }
+    vector<uint8_t> bloom_bytes(bloom.SerializedSize()), cuckoo_bytes(cuckoo.SerializedSize());
+    bloom.Serialize(bloom_bytes.data());
+    cuckoo.Serialize(cuckoo_bytes.data());
+    FarmHash::BlockedBloomFilter bloom_loaded;
+    FarmHash::CuckooFilter cuckoo_loaded;
+    if ( !bloom_loaded.Load(bloom_bytes.data(), bloom_bytes.size()) || !cuckoo_loaded.Load(cuckoo_bytes.data(), cuckoo_bytes.size()) || cuckoo_loaded.Size() != half ) {
+        cerr << "error: filters do not load" << endl;
+        return -1;
+    }
+    unique_ptr<bool[]> in_bloom(new bool[rows]), in_cuckoo(new bool[rows]), in_loaded(new bool[rows]);
+    bloom.Contains(column32.data(), rows, in_bloom.get());
+    cuckoo.Contains(column32.data(), rows, in_cuckoo.get());
+    cuckoo_loaded.Contains(column32.data(), rows, in_loaded.get());
+    for (size_t r = 0; r < rows; r++) {
+        if ( (r < half && !in_bloom[r]) || in_bloom[r] != bloom.Contains(column32[r]) || in_bloom[r] != bloom_loaded.Contains(column32[r])
+          || (r < half && !in_cuckoo[r]) || in_cuckoo[r] != cuckoo.Contains(column32[r]) || in_cuckoo[r] != in_loaded[r] ) {
+            cerr << "error: filters are inconsistent" << endl;
+            return -1;
+        }
+    }
+    for (size_t r = 0; r < half; r++) {
+        if ( !cuckoo_loaded.Erase(column32[r]) ) {
+            cerr << "error: cuckoo filter cannot erase" << endl;
+            return -1;
+        }
+    }
+    if ( cuckoo_loaded.Size() != 0 || cuckoo.Size() != half ) {
+        cerr << "error: cuckoo filter erased the wrong fingerprints" << endl;
+        return -1;
+    }
+
+    // Add the column's fingerprints twice over: every distinct one is a group,
+    // holding each row that has it and that row plus 'rows'.
+
+    FarmHash::ThreadPool pool(2);
+    FarmHash::FingerprintDedup dedup(4, 4096);
+    bool deduped = dedup.Open("/tmp");
+    for (size_t r = 0; deduped && r < 2 * rows; r++) {
+        deduped = dedup.Add(column32[r % rows], r);
+    }
+    size_t grouped = 0;
+    deduped = deduped && dedup.Finish(pool, [&](const UInt128 &fingerprint, const uint64_t *ids, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            deduped = deduped && column32[ids[i] % rows] == fingerprint && (i < n / 2 ? ids[i + n / 2] == ids[i] + rows : ids[i] >= rows);
+        }
+        grouped += n;
+    });
+    if ( !deduped || grouped != 2 * rows ) {
+        cerr << "error: duplicates are not found" << endl;
+        return -1;
+    }
+
+    // The tree fingerprint of all the strings, pinned down, and the same on any
+    // number of threads.
+
+    const UInt128 tree = UInt128(0xcce5789f9efb9501ULL, 0x240eda0b793ad988ULL);
+    FarmHash::ThreadPool three(3);
+    UInt128 trees[] = { FarmHash::Fingerprint128Tree((uint8_t *)all.data(), all.size(), 1000, pool), FarmHash::Fingerprint128Tree((uint8_t *)all.data(), all.size(), 1000, three),
+                        FarmHash::Fingerprint128Tree((uint8_t *)all.data(), all.size(), 1000, 1), FarmHash::Fingerprint128Tree((uint8_t *)all.data(), all.size(), 1000, 3) };
+    for (size_t t = 0; t < 4; t++) {
+        if ( trees[t] != tree ) {
+            cerr << "error: tree hashes are not equal" << endl;
+            return -1;
+        }
     }
+    if ( FarmHash::Fingerprint128Tree((uint8_t *)all.data(), 1000, 1000, three) != FarmHash::Fingerprint128Tree((uint8_t *)all.data(), 1000, 1000, 3)
+      || FarmHash::Fingerprint128Tree((uint8_t *)all.data(), all.size(), 0, three) != UInt128(0, 0) ) {
+        cerr << "error: tree hashes of one piece are not equal" << endl;
+        return -1;
+    }
+
+    // Files on either side of each size threshold, read every way: onto the
+    // stack, mapped, with 'pread' by a reader thread, through a pipe, and (from
+    // 64 MiB) in parallel segments on the pool.
+
+    vector<uint8_t> contents(64 * 1024 * 1024 + 12345);
+    uint64_t lcg = 1;
+    for (size_t b = 0; b < contents.size(); b++) {
+        lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+        contents[b] = static_cast<uint8_t>(lcg >> 56);
+    }
+    const size_t file_sizes[] = { 0, 1000, 16 * 1024, 16 * 1024 + 1, 2 * 1024 * 1024 + 77, contents.size() };
+    for (size_t f = 0; f < sizeof(file_sizes) / sizeof(file_sizes[0]); f++) {
+        size_t length = file_sizes[f];
+        UInt128 expected = FarmHash::Fingerprint128(contents.data(), length), whole, pooled, sized = expected;
+        string path = TemporaryFile(contents.data(), length);
+        int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY);
+        bool filed = fd >= 0 && FarmHash::FingerprintFile(path, whole) && FarmHash::FingerprintFile(path, pooled, three)
+                  && (length == 0 || FarmHash::detail::FingerprintFdSized(fd, length, sized));
+        bool truncated = fd >= 0 && !FarmHash::detail::FingerprintFdSized(fd, length + 1, sized) && errno == EIO;
+        if ( fd >= 0 ) {
+            close(fd);
+        }
+        if ( !path.empty() ) {
+            unlink(path.c_str());
+        }
+        if ( !filed || !truncated || whole != expected || pooled != expected || sized != expected ) {
+            cerr << "error: file hashes are not equal" << endl;
+            return -1;
+        }
+    }
+
+    int ends[2];
+    UInt128 piped;
+    if ( pipe(ends) != 0 ) {
+        cerr << "error: cannot make a pipe" << endl;
+        return -1;
+    }
+    thread writer([&]() {
+        for (size_t done = 0; done < 300000; ) {
+            ssize_t n = write(ends[1], contents.data() + done, 300000 - done);
+            if ( n <= 0 ) {
+                break;
+            }
+            done += n;
+        }
+        close(ends[1]);
+    });
+    bool piped_ok = FarmHash::FingerprintFd(ends[0], piped);
+    writer.join();
+    close(ends[0]);
+    if ( !piped_ok || piped != FarmHash::Fingerprint128(contents.data(), 300000) ) {
+        cerr << "error: piped hashes are not equal" << endl;
+        return -1;
+    }
+
+    // Four threads insert overlapping runs of keys into a set and a map, each
+    // key by two of them, while a fifth looks up what they have inserted; both
+    // start small and grow many times.  Every 400th key is one of a few that
+    // differ only in zero words and the top bits the tables keep in the tag.
+
+    const size_t kShared = 100000;
+    auto shared_key = [](size_t i) {
+        size_t j = i / 400;
+        return i % 400 == 0 ? UInt128((uint64_t(j & 1) << 63) | (j >> 2), uint64_t(j >> 1 & 1) << 63) : UInt128(i * 0x9E3779B97F4A7C15ULL + 1, i * 0xC2B2AE3D27D4EB4FULL);
+    };
+    FarmHash::ConcurrentFingerprintSet shared_set;
+    FarmHash::ConcurrentFingerprintMap<uint64_t> shared_map;
+    vector<vector<char> > won(4, vector<char>(kShared));
+    atomic<size_t> inserted_below[4];
+    atomic<bool> inserting(true), looked_up(true);
+    vector<thread> inserters;
+    for (size_t t = 0; t < 4; t++) {
+        inserted_below[t] = 0;
+        inserters.push_back(thread([&, t]() {
+            for (size_t i = 0; i < kShared; i++) {
+                if ( i % 4 == t || (i + 1) % 4 == t ) {
+                    won[t][i] = char(shared_set.Insert(shared_key(i)) + 2 * shared_map.Insert(shared_key(i), i << 2 | t));
+                }
+                inserted_below[t] = i + 1;
+            }
+        }));
+    }
+    thread looker([&]() {
+        for (size_t n = 0; inserting.load(); n++) {
+            size_t t = n % 4, below = inserted_below[t].load();
+            size_t i = below < 3 ? 0 : 2 + (n * 7919) % (below - 2);
+            i -= i % 4 == t || (i + 1) % 4 == t ? 0 : 2;
+            uint64_t value;
+            if ( below >= 3 && (!shared_set.Contains(shared_key(i)) || !shared_map.Find(shared_key(i), value) || value >> 2 != i) ) {
+                looked_up = false;
+            }
+        }
+    });
+    for (size_t t = 0; t < 4; t++) {
+        inserters[t].join();
+    }
+    inserting = false;
+    looker.join();
+
+    bool shared_ok = looked_up && shared_set.Size() == kShared && shared_map.Size() == kShared;
+    for (size_t i = 0; shared_ok && i < kShared; i++) {
+        size_t set_wins = 0, map_wins = 0, map_winner = 0;
+        for (size_t t = 0; t < 4; t++) {
+            set_wins += won[t][i] & 1;
+            map_wins += won[t][i] >> 1;
+            map_winner = won[t][i] >> 1 ? t : map_winner;
+        }
+        uint64_t value;
+        shared_ok = set_wins == 1 && map_wins == 1 && shared_set.Contains(shared_key(i)) && shared_map.Find(shared_key(i), value) && value == (i << 2 | map_winner)
+                    && !shared_set.Contains(UInt128(UInt128Low64(shared_key(i)), UInt128High64(shared_key(i)) ^ 1));
+    }
+
+    // Sized for them up front, a set holds them all without growing, at about
+    // 18 bytes each.
+
+    FarmHash::ConcurrentFingerprintSet sized(kShared);
+    size_t sized_capacity = sized.Capacity();
+    for (size_t i = 0; shared_ok && i < kShared; i++) {
+        shared_ok = sized.Insert(shared_key(i));
+    }
+    if ( !shared_ok || sized.Capacity() != sized_capacity || sized_capacity * 17 > kShared * 19 ) {
+        cerr << "error: shared fingerprint set or map is wrong" << endl;
+        return -1;
+    }
+
+    // A fingerprint cache of 40000 made-up files, looked up by one thread while
+    // another appends (growing the log and its table past their first 16 Ki
+    // records) and compacts it; then reopened, torn, and refused when foreign.
+
+    char directory[] = "/tmp/farmhash-cache-XXXXXX";
+    if ( !mkdtemp(directory) ) {
+        cerr << "error: cannot make a cache directory" << endl;
+        return -1;
+    }
+    string index = string(directory) + "/index", cached_path = string(directory) + "/file";
+    struct stat made_up;
+    if ( stat(directory, &made_up) != 0 ) {
+        cerr << "error: cannot stat the cache directory" << endl;
+        return -1;
+    }
+    const size_t kCached = 40000;
+    vector<struct stat> files(kCached, made_up);
+    for (size_t c = 0; c < kCached; c++) {
+        files[c].st_ino = c + 1;
+        files[c].st_size = c;
+    }
+    auto cached_fingerprint = [](size_t c) { return UInt128(c, c * 31 + 7); };
+
+    bool cache_ok;
+    {
+        FarmHash::FingerprintCache cache;
+        cache_ok = cache.Open(index);
+        for (size_t c = 0; cache_ok && c < kCached / 4; c++) {
+            cache_ok = cache.Insert(files[c], cached_fingerprint(c));
+        }
+        atomic<bool> appending(true), looked_up(true);
+        thread reader([&]() {
+            for (size_t c = 0; appending.load() || c % (kCached / 4) != 0; c++) {
+                UInt128 fingerprint;
+                if ( !cache.Lookup(files[c % (kCached / 4)], fingerprint) || fingerprint != cached_fingerprint(c % (kCached / 4)) ) {
+                    looked_up = false;
+                }
+            }
+        });
+        for (size_t c = kCached / 4; cache_ok && c < kCached; c++) {
+            cache_ok = cache.Insert(files[c], cached_fingerprint(c)) && (c != kCached / 2 || cache.Compact());
+        }
+        appending = false;
+        reader.join();
+
+        // Supersede the first thousand; compacting drops their old records.
+
+        for (size_t c = 0; cache_ok && c < 1000; c++) {
+            files[c].st_size += kCached;
+            cache_ok = cache.Insert(files[c], cached_fingerprint(c + kCached));
+        }
+        cache_ok = cache_ok && looked_up && cache.Size() == kCached && cache.Compact() && cache.Size() == kCached;
+    }
+    {
+        FarmHash::FingerprintCache cache;
+        cache_ok = cache_ok && cache.Open(index) && cache.Size() == kCached;
+        for (size_t c = 0; cache_ok && c < kCached; c++) {
+            UInt128 fingerprint;
+            cache_ok = cache.Lookup(files[c], fingerprint) && fingerprint == cached_fingerprint(c < 1000 ? c + kCached : c);
+        }
+        struct stat stale = files[0];
+        stale.st_size -= kCached;
+        UInt128 ignored;
+        cache_ok = cache_ok && !cache.Lookup(stale, ignored);
+    }
+
+    // Tear the last record: it is dropped, and the rest are kept.
+
+    int index_fd = open(index.c_str(), O_RDWR);
+    struct stat index_st;
+    uint8_t torn = 0;
+    cache_ok = cache_ok && index_fd >= 0 && fstat(index_fd, &index_st) == 0 && pread(index_fd, &torn, 1, index_st.st_size - 20) == 1;
+    torn ^= 1;
+    cache_ok = cache_ok && pwrite(index_fd, &torn, 1, index_st.st_size - 20) == 1;
+    if ( index_fd >= 0 ) {
+        close(index_fd);
+    }
+    {
+        FarmHash::FingerprintCache cache;
+        cache_ok = cache_ok && cache.Open(index) && cache.Size() == kCached - 1;
+    }
+
+    // A real file, rewritten in place behind the cache's back with its key kept,
+    // is caught by verification and its fingerprint replaced.
+
+    struct timespec old_times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+    UInt128 first, second, third;
+    {
+        FarmHash::FingerprintCache cache;
+        string written = TemporaryFile(contents.data(), 1000);
+        cache_ok = cache_ok && !written.empty() && rename(written.c_str(), cached_path.c_str()) == 0 && utimensat(AT_FDCWD, cached_path.c_str(), old_times, 0) == 0
+                && cache.Open(index) && cache.Fingerprint(cached_path, first) && cache.Misses() == 1;
+        int fd = open(cached_path.c_str(), O_WRONLY);
+        cache_ok = cache_ok && fd >= 0 && pwrite(fd, contents.data() + 1, 1000, 0) == 1000;
+        if ( fd >= 0 ) {
+            close(fd);
+        }
+        cache.SetVerifyEvery(1);
+        cache_ok = cache_ok && utimensat(AT_FDCWD, cached_path.c_str(), old_times, 0) == 0 && cache.Fingerprint(cached_path, second) && cache.Mismatches() == 1;
+        cache.SetVerifyEvery(0);
+        cache_ok = cache_ok && cache.Fingerprint(cached_path, third) && cache.Hits() == 2;
+    }
+    cache_ok = cache_ok && first == FarmHash::Fingerprint128(contents.data(), 1000) && second == FarmHash::Fingerprint128(contents.data() + 1, 1000) && third == second;
+
+    // Another format is refused rather than overwritten.
+
+    uint8_t header[64] = { 'F', 'H', 'C', 'a', 'c', 'h', 'e', 0, 2 };
+    for (int h = 0; h < 2; h++) {
+        string foreign = TemporaryFile(header, sizeof(header));
+        FarmHash::FingerprintCache cache;
+        cache_ok = cache_ok && !foreign.empty() && !cache.Open(foreign) && errno == EINVAL;
+        unlink(foreign.c_str());
+        header[0] = 'X';
+        header[8] = 1;
+    }
+
+    unlink(index.c_str());
+    unlink(cached_path.c_str());
+    rmdir(directory);
+    if ( !cache_ok ) {
+        cerr << "error: fingerprint cache is wrong" << endl;
+        return -1;
+    }
+
+    // Fingerprinted strings as keys: hashed once, kept by copies and moves.
+
+    static_assert(is_nothrow_move_constructible<FarmHash::Fingerprinted<string> >::value && is_nothrow_move_assignable<FarmHash::Fingerprinted<string> >::value, "fingerprinted strings must move without throwing");
+
+    unordered_set<FarmHash::Fingerprinted<string> > keys;
+    for (size_t i = 0; i < test.size(); i++) {
+        FarmHash::Fingerprinted<string> key(string(test[i]));
+        UInt128 fingerprint = key.Fingerprint();
+        FarmHash::Fingerprinted<string> copied(key), moved(std::move(key));
+        if ( fingerprint != FarmHash::Fingerprint128(string(test[i])) || !copied.HasFingerprint() || !moved.HasFingerprint() || key.HasFingerprint() || copied != moved ) {
+            cerr << "error: fingerprinted keys are wrong" << endl;
+            return -1;
+        }
+        keys.insert(std::move(moved));
+    }
+    for (size_t i = 0; i < test.size(); i++) {
+        if ( keys.count(string(test[i])) != 1 || keys.count(string(test[i]) + "!") != 0 ) {
+            cerr << "error: fingerprinted keys are not found" << endl;
+            return -1;
+        }
+    }
+
+    // Edit a copy of the strings in place: the incremental Merkle root matches
+    // one built from scratch.
+
+    string image = all;
+    FarmHash::MerkleFingerprint merkle(64), rebuilt(64);
+    merkle.Reset((uint8_t *)image.data(), image.size());
+    UInt128 original = merkle.Root();
+    for (size_t e = 0; e < image.size(); e += 1 + e % 3001) {
+        image[e] ^= 0x20;
+        merkle.MarkDirty(e, 1);
+    }
+    merkle.MarkDirty(image.size() - 1, SIZE_MAX); // clipped, not overflowed
+    merkle.MarkDirty(SIZE_MAX, 2);
+    rebuilt.Reset((uint8_t *)image.data(), image.size(), pool);
+    if ( merkle.Root(pool) == original || merkle.Root() != rebuilt.Root() ) {
+        cerr << "error: Merkle fingerprints are not equal" << endl;
+        return -1;
+    }
+
+    // Fixed lengths on either side of each CityHash128() path boundary, and fixed-size values.
+
+    bool fixed = FixedMatches<0>(test[0]) && FixedMatches<1>(test[0]) && FixedMatches<3>(test[0]) && FixedMatches<4>(test[0]) && FixedMatches<7>(test[0]) && FixedMatches<8>(test[0])
+              && FixedMatches<15>(test[0]) && FixedMatches<16>(test[0]) && FixedMatches<17>(test[0]) && FixedMatches<31>(test[0]) && FixedMatches<32>(test[0]) && FixedMatches<33>(test[0])
+              && FixedMatches<64>(test[0]) && FixedMatches<100>(test[0]) && FixedMatches<143>(test[0]) && FixedMatches<144>(test[0]) && FixedMatches<200>(test[0]);
+
+    struct Key { uint32_t a, b; uint64_t c; } key = { 1, 2, 3 };
+    const uint8_t little[8] = { 0xef, 0xcd, 0xab, 0x89, 0x67, 0x45, 0x23, 0x01 };
+    fixed = fixed && FarmHash::Fingerprint128(uint64_t(0x0123456789abcdefULL)) == FarmHash::Fingerprint128(little, 8);
+    fixed = fixed && FarmHash::Fingerprint128(0x0123456789abcdefULL) == FarmHash::Fingerprint128(little, 8) && FarmHash::Fingerprint128(int32_t(0x01234567)) == FarmHash::Fingerprint128(little + 4, 4)
+                  && FarmHash::Fingerprint128(int16_t(0x0123)) == FarmHash::Fingerprint128(little + 6, 2);
+    fixed = fixed && FarmHash::Fingerprint128(key) == FarmHash::Fingerprint128((uint8_t *)&key, sizeof(key));
+
+    if ( !fixed ) {
+        cerr << "error: fixed-length hashes are not equal" << endl;
+        return -1;
+    }
+
+    // One call per path, seen by the counters only if they are compiled in.
+
+    FarmHash::HashStats stats = FarmHash::GetHashStats(), before = stats;
+    FarmHash::Fingerprint128((uint8_t *)test[0], 0);
+    FarmHash::Fingerprint128((uint8_t *)test[0], 16 + 20);
+    FarmHash::Fingerprint128((uint8_t *)test[0], 16 + 128 + 40);
+    stats = FarmHash::GetHashStats();
+    stats -= before;
+    bool counted = stats.calls == 3 && stats.bytes == 220 && stats.hash_len_0_to_16 == 1 && stats.city_murmur == 1 && stats.main_loop == 1
+                && stats.blocks == 1 && stats.tail_chunks[2] == 1 && stats.lengths[0] == 1 && stats.lengths[6] == 1 && stats.lengths[8] == 1;
+    if ( FarmHash::kHashStatsEnabled ? !counted : stats.calls != 0 || before.calls != 0 ) {
+        cerr << "error: hash statistics are wrong" << endl;
+        return -1;
+    }
+
+#if FARM_HASH_HAS_CONSTEXPR
+
+    // One input per CityHash128() path: 'HashLen0to16()', 'CityMurmur()' and the main loop.
+
+    using namespace FarmHash::literals;
+    static constexpr UInt128 constant[] = { ""_fp128, "farm"_fp128, "0123456789abcdef0123456789abcdef0123456789abcdef"_fp128, "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"_fp128 };
+    static const char *const text[] = { "", "farm", "0123456789abcdef0123456789abcdef0123456789abcdef", "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef" };
+
+    for (int i = 0; i < 4; i++) {
+        if ( constant[i] != FarmHash::Fingerprint128((uint8_t *)text[i], strlen(text[i])) ) {
+            cerr << "error: constexpr hashes are not equal" << endl;
+            return -1;
+        }
+    }
+
+#endif
 
     return 0;
 }
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Checks `farmsum` on a small tree: every line against `fingerprint128`, names
+# holding a backslash or a newline escaped, an empty file, the output read back
+# by `-c`, and `-c` failing on a changed file or a list with no checksums.
+
+fail() {
+    printf 'error: %s\n' "$*" >&2
+    exit 1
+}
+
+tree=$(mktemp -d "${TMPDIR:-/tmp}/farmsum-check.XXXXXX") || exit 1
+trap 'rm -rf "$tree"' EXIT
+mkdir "$tree/files"
+
+newline='
+'
+: > "$tree/files/a-empty"
+echo 'back slash' > "$tree/files/b-back\\slash"
+echo 'new line' > "$tree/files/c-new${newline}line"
+echo 'plain text' > "$tree/files/d-text"
+i=0
+while [ $i -lt 20000 ]; do
+    echo "line $i"
+    i=$((i + 1))
+done > "$tree/files/e-large"
+
+expect() {
+    hex=$(./fingerprint128 < "$tree/files/$1") || exit 1
+    printf '%s%s  %s/files/%s\n' "$2" "$hex" "$tree" "$3"
+}
+{
+    expect a-empty "" a-empty
+    expect "b-back\\slash" "\\" "b-back\\\\slash"
+    expect "c-new${newline}line" "\\" "c-new\\nline"
+    expect d-text "" d-text
+    expect e-large "" e-large
+} > "$tree/expected"
+
+./farmsum "$tree/files" > "$tree/sums" || fail "farmsum exited $?"
+cmp -s "$tree/sums" "$tree/expected" || fail "farmsum and fingerprint128 differ: $(diff "$tree/sums" "$tree/expected")"
+
+./farmsum -c "$tree/sums" > "$tree/checked" || fail "farmsum -c rejected its own output"
+[ "$(grep -c ': OK$' "$tree/checked")" -eq 5 ] || fail "farmsum -c did not check every file"
+
+echo 'changed text' > "$tree/files/d-text"
+./farmsum -c --status "$tree/sums" && fail "farmsum -c passed a changed file"
+./farmsum -c --status /dev/null 2> /dev/null && fail "farmsum -c passed a list with no checksums"
+
+echo "farmsum: OK"
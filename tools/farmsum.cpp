@@ -0,0 +1,386 @@
+// `farmsum`: print or check `Fingerprint128` checksums, in the manner of `sha256sum`.
+//
+//     farmsum [-j THREADS] [--cache INDEX] [FILE | DIRECTORY]... > SUMS
+//     farmsum -c [--quiet | --status] SUMS...
+//
+// Each line of output is the 32 hex digits of `UInt128ToHex()`, two spaces and
+// the file name, as `sha256sum` writes them (names holding a backslash or a
+// newline are escaped, and the line marked with a leading backslash).
+// Directories are walked recursively, in name order; symbolic links to
+// directories and anything other than a regular file found while walking
+// are skipped.  `-` (or no arguments at all) is standard input.
+//
+// Files are fingerprinted on a work-stealing `ThreadPool`, one task per file,
+// and printed in the order they were named.  Files of 64 MiB or more are also
+// read in parallel, several segments at a time (see `FarmHashFile.hpp`).
+//
+// `--cache INDEX` keeps the fingerprints in a `FingerprintCache`, so a file
+// unchanged since an earlier run (same device, inode, size and mtime) is not
+// read again.  It cannot be combined with `-c`, which is meant to read.  An
+// index locked by another process is left alone, with a warning, and every
+// file read.
+//
+// `-c` reads `sha256sum`-style lines (a `*` before the name is accepted and
+// ignored) and reports each file as `OK` or `FAILED`, with the same summary
+// warnings; `--quiet` leaves out the `OK` lines and `--status` prints nothing.
+// The exit status is 1 if any file could not be read or did not match, or if
+// a checksum file held no checksums.
+//
+#include "FarmHashFile.hpp"
+#include "FingerprintCache.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+using FarmHash::FingerprintCache;
+using FarmHash::ThreadPool;
+
+namespace {
+
+    struct Options {
+        unsigned threads;
+        bool check;
+        bool quiet;
+        bool status;
+        FingerprintCache *cache;    // or null
+    };
+
+    // One file to fingerprint, and (when checking) the fingerprint it should have.
+
+    struct Job {
+        string path;
+        UInt128 expected;
+        UInt128 fingerprint;
+        int error;
+        bool done;
+    };
+
+    // Jobs are run on the pool and reported in the order they were added.
+    // Adding one waits while more than a few per thread are unreported, so a
+    // large tree is not queued up (and held in memory) all at once.
+
+    class Jobs {
+
+    public:
+
+        Jobs(ThreadPool &pool, const Options &options) : pool_(pool), options_(options), unreadable_(0), mismatched_(0) {}
+
+        void Add(const string &path, const UInt128 &expected = UInt128()) {
+            Job job = { path, expected, UInt128(), 0, false };
+            jobs_.push_back(job);
+            Job *added = &jobs_.back();
+            pool_.Submit([this, added]() { Run(*added); });
+            Report(kPendingPerThread * pool_.Size());
+        }
+
+        // Report everything, waiting for jobs still running.
+
+        void Finish() {
+            Report(0);
+        }
+
+        size_t Unreadable() const { return unreadable_; }
+        size_t Mismatched() const { return mismatched_; }
+
+    private:
+
+        static const size_t kPendingPerThread = 4;
+
+        void Run(Job &job) {
+            UInt128 fingerprint;
+            bool ok;
+            if (job.path == "-") {
+                ok = FarmHash::FingerprintFd(STDIN_FILENO, fingerprint);
+            } else if (options_.cache) {
+                ok = options_.cache->Fingerprint(job.path, fingerprint, pool_);
+            } else {
+                ok = FarmHash::FingerprintFile(job.path, fingerprint, pool_);
+            }
+            int error = ok ? 0 : errno;
+            lock_guard<mutex> lock(mutex_);
+            job.fingerprint = fingerprint;
+            job.error = error;
+            job.done = true;
+            done_.notify_all();
+        }
+
+        // Report the jobs that are done, in order, waiting until no more than
+        // 'pending' are left.
+
+        void Report(size_t pending) {
+            unique_lock<mutex> lock(mutex_);
+            while (!jobs_.empty()) {
+                Job &job = jobs_.front();
+                if (!job.done) {
+                    if (jobs_.size() <= pending) {
+                        return;
+                    }
+                    done_.wait(lock);
+                    continue;
+                }
+                Print(job);
+                jobs_.pop_front();
+            }
+        }
+
+        void Print(const Job &job) {
+            string name = Escape(job.path);
+            const char *mark = name.size() != job.path.size() ? "\\" : "";
+            if (job.error) {
+                fprintf(stderr, "farmsum: %s: %s\n", job.path.c_str(), strerror(job.error));
+                unreadable_++;
+                if (options_.check && !options_.status) {
+                    printf("%s%s: FAILED open or read\n", mark, name.c_str());
+                }
+            } else if (!options_.check) {
+                printf("%s%s  %s\n", mark, UInt128ToHex(job.fingerprint).c_str(), name.c_str());
+            } else if (job.fingerprint != job.expected) {
+                mismatched_++;
+                if (!options_.status) {
+                    printf("%s%s: FAILED\n", mark, name.c_str());
+                }
+            } else if (!options_.quiet && !options_.status) {
+                printf("%s%s: OK\n", mark, name.c_str());
+            }
+        }
+
+        static string Escape(const string &path) {
+            string escaped;
+            for (size_t i = 0; i < path.size(); i++) {
+                if (path[i] == '\\') {
+                    escaped += "\\\\";
+                } else if (path[i] == '\n') {
+                    escaped += "\\n";
+                } else {
+                    escaped += path[i];
+                }
+            }
+            return escaped;
+        }
+
+        ThreadPool &pool_;
+        const Options &options_;
+        deque<Job> jobs_;           // not yet reported; the deque keeps them in place
+        size_t unreadable_, mismatched_;
+        mutex mutex_;
+        condition_variable done_;
+
+    };
+
+    // -----------------------------------------------------------------
+    // Input.
+
+    bool Walk(const string &directory, Jobs &jobs) {
+        DIR *dir = opendir(directory.c_str());
+        if (!dir) {
+            fprintf(stderr, "farmsum: %s: %s\n", directory.c_str(), strerror(errno));
+            return false;
+        }
+        vector<string> names;
+        while (struct dirent *entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                names.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+        sort(names.begin(), names.end());
+        bool ok = true;
+        for (size_t i = 0; i < names.size(); i++) {
+            string path = directory + (directory[directory.size() - 1] == '/' ? "" : "/") + names[i];
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0) {
+                fprintf(stderr, "farmsum: %s: %s\n", path.c_str(), strerror(errno));
+                ok = false;
+            } else if (S_ISDIR(st.st_mode)) {
+                ok = Walk(path, jobs) && ok;
+            } else if (S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode) && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))) {
+                jobs.Add(path);
+            }
+        }
+        return ok;
+    }
+
+    // The name and fingerprint on one line of a checksum file, if it is one.
+
+    bool ParseLine(string line, string &path, UInt128 &fingerprint) {
+        bool escaped = !line.empty() && line[0] == '\\';
+        if (escaped) {
+            line.erase(0, 1);
+        }
+        if (line.size() < 35 || !UInt128FromHex(line.data(), 32, fingerprint) || line[32] != ' ' || (line[33] != ' ' && line[33] != '*')) {
+            return false;
+        }
+        path.clear();
+        for (size_t i = 34; i < line.size(); i++) {
+            if (escaped && line[i] == '\\' && i + 1 < line.size()) {
+                i++;
+                if (line[i] == 'n') {
+                    path += '\n';
+                } else if (line[i] == '\\') {
+                    path += '\\';
+                } else {
+                    return false;
+                }
+            } else {
+                path += line[i];
+            }
+        }
+        return true;
+    }
+
+    // Returns the number of improperly formatted lines, or -1 if the file
+    // cannot be read or holds no checksums at all.
+
+    long ReadChecksums(const string &name, Jobs &jobs) {
+        FILE *file = name == "-" ? stdin : fopen(name.c_str(), "r");
+        if (!file) {
+            fprintf(stderr, "farmsum: %s: %s\n", name.c_str(), strerror(errno));
+            return -1;
+        }
+        long bad = 0, good = 0;
+        string line;
+        for (int c; (c = getc(file)) != EOF; ) {
+            if (c != '\n') {
+                line += static_cast<char>(c);
+                continue;
+            }
+            string path;
+            UInt128 fingerprint;
+            if (ParseLine(line, path, fingerprint)) {
+                jobs.Add(path, fingerprint);
+                good++;
+            } else {
+                bad++;
+            }
+            line.clear();
+        }
+        if (!line.empty()) {
+            string path;
+            UInt128 fingerprint;
+            if (ParseLine(line, path, fingerprint)) {
+                jobs.Add(path, fingerprint);
+                good++;
+            } else {
+                bad++;
+            }
+        }
+        bool failed = ferror(file) != 0;
+        if (file != stdin) {
+            fclose(file);
+        }
+        if (failed || good == 0) {
+            fprintf(stderr, "farmsum: %s: %s\n", name.c_str(), failed ? strerror(EIO) : "no properly formatted checksum lines found");
+            return -1;
+        }
+        return bad;
+    }
+
+    void Warn(size_t n, const char *one, const char *many) {
+        if (n) {
+            fprintf(stderr, "farmsum: WARNING: %zu %s\n", n, n == 1 ? one : many);
+        }
+    }
+
+    void Usage() {
+        fprintf(stderr, "usage: farmsum [-j THREADS] [--cache INDEX] [FILE | DIRECTORY]...\n"
+                        "       farmsum -c [-j THREADS] [--quiet | --status] [SUMS]...\n");
+        exit(2);
+    }
+
+}
+
+int main(int argc, char const *argv[])
+{
+
+    Options options = { 0, false, false, false, 0 };
+    vector<string> names;
+    const char *index = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-c" || arg == "--check") {
+            options.check = true;
+        } else if ((arg == "-j" || arg == "--threads") && i + 1 < argc) {
+            options.threads = static_cast<unsigned>(strtoul(argv[++i], 0, 10));
+        } else if (arg == "--cache" && i + 1 < argc) {
+            index = argv[++i];
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "--status") {
+            options.status = true;
+        } else if (arg == "--") {
+            names.insert(names.end(), argv + i + 1, argv + argc);
+            break;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            Usage();
+        } else {
+            names.push_back(arg);
+        }
+    }
+    if ((options.quiet || options.status) && !options.check) {
+        Usage();
+    }
+    if (index && options.check) {
+        Usage();
+    }
+    if (names.empty()) {
+        names.push_back("-");
+    }
+
+    FingerprintCache cache;
+    if (index) {
+        if (cache.Open(index)) {
+            options.cache = &cache;
+        } else if (errno == EWOULDBLOCK) {
+            fprintf(stderr, "farmsum: %s: locked by another process; not using it\n", index);
+        } else {
+            fprintf(stderr, "farmsum: %s: %s\n", index, strerror(errno));
+            return 1;
+        }
+    }
+
+    ThreadPool pool(options.threads);
+    Jobs jobs(pool, options);
+    bool ok = true;
+    size_t bad_lines = 0;
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (options.check) {
+            long bad = ReadChecksums(names[i], jobs);
+            ok = ok && bad >= 0;
+            bad_lines += bad > 0 ? bad : 0;
+            continue;
+        }
+        struct stat st;
+        if (names[i] != "-" && stat(names[i].c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            ok = Walk(names[i], jobs) && ok;
+        } else {
+            jobs.Add(names[i]);
+        }
+    }
+
+    jobs.Finish();
+    pool.Wait();
+
+    if (options.check && !options.status) {
+        Warn(bad_lines, "line is improperly formatted", "lines are improperly formatted");
+        Warn(jobs.Unreadable(), "listed file could not be read", "listed files could not be read");
+        Warn(jobs.Mismatched(), "computed checksum did NOT match", "computed checksums did NOT match");
+    }
+
+    return ok && jobs.Unreadable() == 0 && jobs.Mismatched() == 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+// `fingerprint128`: print `UInt128ToHex(Fingerprint128())` of all of standard
+// input, read into memory in one piece.  `check.sh` compares `farmsum` with it.
+//
+#include "FarmHash.hpp"
+#include "UInt128.hpp"
+
+#include <cstdio>
+#include <vector>
+
+int main() {
+    std::vector<uint8_t> contents;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), stdin)) > 0) {
+        contents.insert(contents.end(), buffer, buffer + n);
+    }
+    if (ferror(stdin)) {
+        perror("fingerprint128");
+        return 1;
+    }
+    printf("%s\n", UInt128ToHex(FarmHash::Fingerprint128(contents.data(), contents.size())).c_str());
+    return 0;
+}